@@ -8,6 +8,11 @@
 #include <cassert>
 #include <array>
 #include <stdio.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 void *xmalloc(size_t size)
 {
@@ -19,25 +24,99 @@ void *xmalloc(size_t size)
     exit(-1);
 }
 
-void *Arena::alloc(size_t bytes)
+namespace
 {
-    const size_t pageSize = 1024 * 1024 * 50;
+    // every page starts with this, allocs comes after it
+    struct PageHeader
+    {
+        uint8_t *next;
+        size_t size;
+    };
+
+    inline PageHeader *header(uint8_t *page)
+    {
+        return reinterpret_cast<PageHeader *>(page);
+    }
+
+    const size_t huge_page_size = 2 * 1024 * 1024;
+}
+
+/**
+ * Page with room for bytes, from free list if we have one big enough
+ */
+uint8_t *Arena::get_page(size_t bytes)
+{
+    uint8_t **link = &free_pages;
+    while (*link != nullptr)
+    {
+        auto *page = *link;
+        if (header(page)->size >= bytes)
+        {
+            *link = header(page)->next;
+            free_size -= header(page)->size;
+            header(page)->next = nullptr;
+            return page;
+        }
+        link = &header(page)->next;
+    }
 
+    size_t page_bytes = std::max(page_size, bytes);
+    uint8_t *page = nullptr;
+
+#ifdef __linux__
+    if (huge_pages)
+    {
+        page_bytes = (page_bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+        void *aligned = nullptr;
+        if (posix_memalign(&aligned, huge_page_size, page_bytes) != 0)
+        {
+            fprintf(stderr, "Failed to allocate memory.");
+            exit(-1);
+        }
+        madvise(aligned, page_bytes, MADV_HUGEPAGE);
+        page = (uint8_t *)aligned;
+    }
+#endif
+
+    if (page == nullptr)
+    {
+        page = (uint8_t *)xmalloc(page_bytes);
+    }
+
+    header(page)->next = nullptr;
+    header(page)->size = page_bytes;
+    return page;
+}
+
+/**
+ * Puts page on free list if we are below keep_size, else gives it back
+ */
+void Arena::recycle_page(uint8_t *page)
+{
+    auto page_bytes = header(page)->size;
+    if (free_size + page_bytes <= keep_size)
+    {
+        header(page)->next = free_pages;
+        free_pages = page;
+        free_size += page_bytes;
+        return;
+    }
+
+    free(page);
+}
+
+void *Arena::alloc(size_t bytes)
+{
     if (bytes == 0)
         return nullptr;
 
     auto padded = (bytes + 7) & ~7;
 
-    auto a = size;
-    auto f = fill;
-
     if (size < fill + padded)
     {
-        fill = sizeof(uint8_t *);
-        size = std::max(pageSize, fill + padded);
-
-        auto *page = (uint8_t *)xmalloc(size);
-        *(uint8_t **)page = nullptr;
+        auto *page = get_page(sizeof(PageHeader) + padded);
+        fill = sizeof(PageHeader);
+        size = header(page)->size;
 
         if (first == nullptr)
         {
@@ -46,14 +125,14 @@ void *Arena::alloc(size_t bytes)
         }
         else
         {
-            *(uint8_t **)curr = page; // update next
+            header(curr)->next = page; // update next
             curr = page;
         }
     }
 
     assert(first != nullptr);
     assert(curr != nullptr);
-    assert(*(uint8_t **)curr == nullptr);
+    assert(header(curr)->next == nullptr);
     assert(fill + padded <= size);
 
     auto *rv = curr + fill;
@@ -73,8 +152,8 @@ void Arena::clear()
     auto *c = first;
     while (c != nullptr)
     {
-        auto *n = *(uint8_t **)c;
-        free(c);
+        auto *n = header(c)->next;
+        recycle_page(c);
         c = n;
     }
     first = nullptr;
@@ -83,7 +162,43 @@ void Arena::clear()
     size = 0;
 }
 
+// keeps first page so it can be used again without malloc, used for scratch memory
+void Arena::reset()
+{
+    if (first == nullptr)
+    {
+        return;
+    }
+
+    auto *c = header(first)->next;
+    while (c != nullptr)
+    {
+        auto *n = header(c)->next;
+        recycle_page(c);
+        c = n;
+    }
+    header(first)->next = nullptr;
+    curr = first;
+    fill = sizeof(PageHeader);
+    size = header(first)->size;
+}
+
+// gives back pages kept on free list
+void Arena::trim()
+{
+    auto *c = free_pages;
+    while (c != nullptr)
+    {
+        auto *n = header(c)->next;
+        free(c);
+        c = n;
+    }
+    free_pages = nullptr;
+    free_size = 0;
+}
+
 Arena::~Arena()
 {
     clear();
-}
\ No newline at end of file
+    trim();
+}
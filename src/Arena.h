@@ -18,14 +18,30 @@ struct Arena
     Arena &operator=(const Arena &) = delete;
     ~Arena();
 
+    // size of new pages, allocs bigger than this gets a page of its own
+    size_t page_size = 1024 * 1024 * 50;
+    // bytes of cleared pages kept for later allocs instead of freed, 0 frees all pages on clear
+    size_t keep_size = 0;
+    // ask for transparent huge pages, only linux
+    bool huge_pages = false;
+
     uint8_t *first = nullptr;
     uint8_t *curr = nullptr;
     size_t fill = 0;
     size_t size = 0;
 
+    // cleared pages waiting to be used again
+    uint8_t *free_pages = nullptr;
+    size_t free_size = 0;
+
     void *alloc(size_t bytes);
     void *dup(const void *src, size_t bytes);
     void clear();
+    void reset();
+    void trim();
+
+    uint8_t *get_page(size_t bytes);
+    void recycle_page(uint8_t *page);
 
     template <typename T>
     T *alloc() { return new (alloc(sizeof(T))) T(); }
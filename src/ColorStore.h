@@ -4,6 +4,7 @@
  */
 
 #pragma once
+#include <cstdint>
 #include <unordered_map>
 class ColorStore
 {
@@ -11,6 +12,13 @@ class ColorStore
 public:
     std::unordered_map<uint32_t, uint32_t> p_id_hex;
 
+    // unknown index is black
+    uint32_t get_color(uint32_t index) const
+    {
+        auto search = p_id_hex.find(index);
+        return search != p_id_hex.end() ? search->second : 0;
+    }
+
     ColorStore()
     {
         p_id_hex.insert_or_assign(1, 0x000000);
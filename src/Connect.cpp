@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Connect.h"
+#include "LinAlgOps.h"
+
+namespace
+{
+
+  struct Anchor
+  {
+    Geometry *geo;
+    Vec3f p;
+    Vec3f d;
+    unsigned o;
+    Connection::Flags flag;
+  };
+
+  // faces must point almost straight at each other
+  const float facing = -0.98f;
+
+  void addAnchor(std::vector<Anchor> &anchors, Geometry *geo, const Vec3f &p, const Vec3f &d, unsigned o, Connection::Flags flag)
+  {
+    auto world_d = mul(makeMat3f(geo->M_3x4.data), d);
+    auto length = std::sqrt(dot(world_d, world_d));
+    if (!(length > 0.f) || !std::isfinite(length))
+    {
+      return;
+    }
+
+    // sort and sweep needs finite positions
+    auto world_p = mul(geo->M_3x4, p);
+    if (!std::isfinite(world_p.x) || !std::isfinite(world_p.y) || !std::isfinite(world_p.z))
+    {
+      return;
+    }
+
+    Anchor anchor;
+    anchor.geo = geo;
+    anchor.p = world_p;
+    anchor.d = (1.f / length) * world_d;
+    anchor.o = o;
+    anchor.flag = flag;
+    anchors.push_back(anchor);
+  }
+
+  // face of 4 corners, outward is away from center of shape
+  void addQuadAnchor(std::vector<Anchor> &anchors, Geometry *geo, const Vec3f *q, const Vec3f &center, unsigned o)
+  {
+    Vec3f p = 0.25f * (q[0] + q[1] + q[2] + q[3]);
+    Vec3f n = cross(q[2] - q[0], q[3] - q[1]);
+    if (!(lengthSquared(n) > 1e-14f))
+    {
+      return;
+    }
+    if (dot(n, p - center) < 0.f)
+    {
+      n = -1.f * n;
+    }
+    addAnchor(anchors, geo, p, n, o, Connection::Flags::HasRectangularSide);
+  }
+
+  void addAnchors(std::vector<Anchor> &anchors, Geometry *geo)
+  {
+    const auto circular = Connection::Flags::HasCircularSide;
+    const auto rectangular = Connection::Flags::HasRectangularSide;
+
+    switch (geo->kind)
+    {
+    case Geometry::Kind::Pyramid:
+    {
+      // same corners as pyramid factory
+      auto bx = 0.5f * geo->pyramid.bottom[0];
+      auto by = 0.5f * geo->pyramid.bottom[1];
+      auto tx = 0.5f * geo->pyramid.top[0];
+      auto ty = 0.5f * geo->pyramid.top[1];
+      auto ox = 0.5f * geo->pyramid.offset[0];
+      auto oy = 0.5f * geo->pyramid.offset[1];
+      auto h2 = 0.5f * geo->pyramid.height;
+      Vec3f quad[2][4] = {
+          {makeVec3f(-bx - ox, -by - oy, -h2),
+           makeVec3f(bx - ox, -by - oy, -h2),
+           makeVec3f(bx - ox, by - oy, -h2),
+           makeVec3f(-bx - ox, by - oy, -h2)},
+          {makeVec3f(-tx + ox, -ty + oy, h2),
+           makeVec3f(tx + ox, -ty + oy, h2),
+           makeVec3f(tx + ox, ty + oy, h2),
+           makeVec3f(-tx + ox, ty + oy, h2)},
+      };
+      Vec3f center = makeVec3f(0.f, 0.f, 0.f);
+      for (unsigned k = 0; k < 4; k++)
+      {
+        unsigned kk = (k + 1) & 3;
+        Vec3f side[4] = {quad[0][k], quad[0][kk], quad[1][kk], quad[1][k]};
+        addQuadAnchor(anchors, geo, side, center, k);
+      }
+      if (1e-7f <= std::min(std::abs(geo->pyramid.bottom[0]), std::abs(geo->pyramid.bottom[1])))
+      {
+        addAnchor(anchors, geo, makeVec3f(-ox, -oy, -h2), makeVec3f(0.f, 0.f, -1.f), 4, rectangular);
+      }
+      if (1e-7f <= std::min(std::abs(geo->pyramid.top[0]), std::abs(geo->pyramid.top[1])))
+      {
+        addAnchor(anchors, geo, makeVec3f(ox, oy, h2), makeVec3f(0.f, 0.f, 1.f), 5, rectangular);
+      }
+      break;
+    }
+    case Geometry::Kind::Box:
+    {
+      // -x, +x, -y, +y, -z, +z, same order as box factory
+      auto xp = 0.5f * geo->box.lengths[0];
+      auto yp = 0.5f * geo->box.lengths[1];
+      auto zp = 0.5f * geo->box.lengths[2];
+      addAnchor(anchors, geo, makeVec3f(-xp, 0.f, 0.f), makeVec3f(-1.f, 0.f, 0.f), 0, rectangular);
+      addAnchor(anchors, geo, makeVec3f(xp, 0.f, 0.f), makeVec3f(1.f, 0.f, 0.f), 1, rectangular);
+      addAnchor(anchors, geo, makeVec3f(0.f, -yp, 0.f), makeVec3f(0.f, -1.f, 0.f), 2, rectangular);
+      addAnchor(anchors, geo, makeVec3f(0.f, yp, 0.f), makeVec3f(0.f, 1.f, 0.f), 3, rectangular);
+      addAnchor(anchors, geo, makeVec3f(0.f, 0.f, -zp), makeVec3f(0.f, 0.f, -1.f), 4, rectangular);
+      addAnchor(anchors, geo, makeVec3f(0.f, 0.f, zp), makeVec3f(0.f, 0.f, 1.f), 5, rectangular);
+      break;
+    }
+    case Geometry::Kind::RectangularTorus:
+    {
+      auto &tor = geo->rectangularTorus;
+      auto r = 0.5f * (tor.inner_radius + tor.outer_radius);
+      auto c = std::cos(tor.angle);
+      auto s = std::sin(tor.angle);
+      addAnchor(anchors, geo, makeVec3f(r, 0.f, 0.f), makeVec3f(0.f, -1.f, 0.f), 0, rectangular);
+      addAnchor(anchors, geo, makeVec3f(r * c, r * s, 0.f), makeVec3f(-s, c, 0.f), 1, rectangular);
+      break;
+    }
+    case Geometry::Kind::CircularTorus:
+    {
+      auto &tor = geo->circularTorus;
+      auto c = std::cos(tor.angle);
+      auto s = std::sin(tor.angle);
+      addAnchor(anchors, geo, makeVec3f(tor.offset, 0.f, 0.f), makeVec3f(0.f, -1.f, 0.f), 0, circular);
+      addAnchor(anchors, geo, makeVec3f(tor.offset * c, tor.offset * s, 0.f), makeVec3f(-s, c, 0.f), 1, circular);
+      break;
+    }
+    case Geometry::Kind::EllipticalDish:
+    case Geometry::Kind::SphericalDish:
+      addAnchor(anchors, geo, makeVec3f(0.f, 0.f, 0.f), makeVec3f(0.f, 0.f, -1.f), 0, circular);
+      break;
+
+    case Geometry::Kind::Snout:
+    {
+      // same as snout cap normals
+      auto &sn = geo->snout;
+      auto ox = 0.5f * sn.offset[0];
+      auto oy = 0.5f * sn.offset[1];
+      auto h2 = 0.5f * sn.height;
+      addAnchor(anchors, geo, makeVec3f(-ox, -oy, -h2),
+                makeVec3f(std::sin(sn.bshear[0]) * std::cos(sn.bshear[1]), std::sin(sn.bshear[1]), -std::cos(sn.bshear[0]) * std::cos(sn.bshear[1])),
+                0, circular);
+      addAnchor(anchors, geo, makeVec3f(ox, oy, h2),
+                makeVec3f(-std::sin(sn.tshear[0]) * std::cos(sn.tshear[1]), -std::sin(sn.tshear[1]), std::cos(sn.tshear[0]) * std::cos(sn.tshear[1])),
+                1, circular);
+      break;
+    }
+    case Geometry::Kind::Cylinder:
+    {
+      auto h2 = 0.5f * geo->cylinder.height;
+      addAnchor(anchors, geo, makeVec3f(0.f, 0.f, -h2), makeVec3f(0.f, 0.f, -1.f), 0, circular);
+      addAnchor(anchors, geo, makeVec3f(0.f, 0.f, h2), makeVec3f(0.f, 0.f, 1.f), 1, circular);
+      break;
+    }
+    default:
+      // spheres, lines and facet groups have nothing to connect
+      break;
+    }
+  }
+
+}
+
+size_t connect_geometries(Arena *arena, Geometry *const *geometries, size_t count, float epsilon)
+{
+  std::vector<Anchor> anchors;
+  anchors.reserve(2 * count);
+  for (size_t i = 0; i < count; i++)
+  {
+    addAnchors(anchors, geometries[i]);
+  }
+
+  // float positions far from origin are not more exact than this
+  float largest = 0.f;
+  for (auto &anchor : anchors)
+  {
+    for (unsigned k = 0; k < 3; k++)
+    {
+      largest = std::max(largest, std::abs(anchor.p.data[k]));
+    }
+  }
+  epsilon = std::max(epsilon, 1e-6f * largest);
+  const float epsilon_squared = epsilon * epsilon;
+
+  // sweep along x, only anchors within epsilon in x can match
+  std::sort(anchors.begin(), anchors.end(), [](const Anchor &a, const Anchor &b)
+            { return a.p.x < b.p.x; });
+
+  size_t connection_count = 0;
+  for (size_t i = 0; i < anchors.size(); i++)
+  {
+    auto &a = anchors[i];
+    for (size_t j = i + 1; j < anchors.size() && anchors[j].p.x - a.p.x <= epsilon; j++)
+    {
+      auto &b = anchors[j];
+      if (a.geo == b.geo || a.geo->connections[a.o] != nullptr || b.geo->connections[b.o] != nullptr)
+      {
+        continue;
+      }
+      if (distanceSquared(a.p, b.p) > epsilon_squared || dot(a.d, b.d) > facing)
+      {
+        continue;
+      }
+
+      auto *connection = arena->alloc<Connection>();
+      connection->geo[0] = a.geo;
+      connection->offset[0] = a.o;
+      connection->geo[1] = b.geo;
+      connection->offset[1] = b.o;
+      connection->p = a.p;
+      connection->d = a.d;
+      connection->setFlag(a.flag);
+      connection->setFlag(b.flag);
+
+      a.geo->connections[a.o] = connection;
+      b.geo->connections[b.o] = connection;
+      connection_count++;
+    }
+  }
+
+  return connection_count;
+}
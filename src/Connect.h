@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include "Arena.h"
+#include "Geometry.h"
+
+/**
+ * Links primitives that meet end to end, like pipe segments and bends, through Geometry::connections
+ * Each connectable face (cylinder/snout/torus ends, dish base, box and pyramid sides) gets an anchor point
+ * and outward direction in world space. Anchors at same spot facing each other are connected.
+ * Factories use these to skip caps that are hidden inside the neighbour
+ * Connections are allocated in arena, returns number of connections made
+ */
+size_t connect_geometries(Arena *arena, Geometry *const *geometries, size_t count, float epsilon);
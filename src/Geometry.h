@@ -29,6 +29,7 @@ struct Triangulation
     // need to be cleared manually
     Arena *arena = nullptr;
 
+    // world space with Y up (glTF), except for cached shapes that stays in local space
     float *vertices = nullptr;
     float *normals = nullptr;
     uint32_t *indices = 0;
@@ -37,6 +38,13 @@ struct Triangulation
     uint32_t id = 0;
     uint32_t color = 0;
     float error = 0.f;
+    // of vertices
+    BBox3f bbox;
+
+    // set when this is a placed copy of a cached triangulation, see Tessellator
+    // vertices are shape vertices transformed with transform
+    const Triangulation *shape = nullptr;
+    const Mat3x4f *transform = nullptr;
 };
 
 struct Connection
@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "GlbWriter.h"
+#include "meshoptimizer-0.21/src/meshoptimizer.h"
+
+namespace
+{
+
+    const uint32_t glb_magic = 0x46546C67;   // glTF
+    const uint32_t glb_version = 2;
+    const uint32_t chunk_json = 0x4E4F534A;  // JSON
+    const uint32_t chunk_bin = 0x004E4942;   // BIN
+
+    void write_u32(std::ofstream &file, uint32_t value)
+    {
+        // glb is little endian, same as all platforms we build for
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    size_t pad4(size_t size)
+    {
+        return (size + 3) & ~size_t(3);
+    }
+
+}
+
+GlbWriter::GlbWriter(Compression compression) : p_compression(compression), p_extras(p_extras_buffer)
+{
+    p_extras.StartObject();
+}
+
+int GlbWriter::add_accessor(const void *data, size_t byte_length, ComponentType component_type, const char *type, size_t count, Target target, const double *min_values, const double *max_values)
+{
+    unsigned components = std::strcmp(type, "SCALAR") == 0 ? 1 : type[3] - '0';
+    unsigned element_size = (component_type == Short ? 2 : 4) * components;
+
+    BufferView view;
+    view.data = data;
+    view.byte_offset = p_buffer_size;
+    view.byte_length = byte_length;
+    view.target = target;
+    view.bin_offset = p_bin_size;
+    view.bin_length = byte_length;
+    view.mode = nullptr;
+    // vertex attributes must be 4 byte aligned, so short vec3 takes 8 bytes
+    view.byte_stride = static_cast<unsigned>(pad4(element_size));
+    view.padded = view.byte_stride != element_size;
+    view.count = count;
+
+    if (p_compression == Compression::meshopt)
+    {
+        std::vector<unsigned char> encoded;
+        if (target == ElementArrayBuffer && count % 3 == 0)
+        {
+            auto *indices = reinterpret_cast<const unsigned int *>(data);
+            unsigned int max_index = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                max_index = std::max(max_index, indices[i]);
+            }
+            encoded.resize(meshopt_encodeIndexBufferBound(count, size_t(max_index) + 1));
+            encoded.resize(meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), indices, count));
+            view.mode = "TRIANGLES";
+        }
+        else
+        {
+            encoded.resize(meshopt_encodeVertexBufferBound(count, view.byte_stride));
+            encoded.resize(meshopt_encodeVertexBuffer(encoded.data(), encoded.size(), data, count, view.byte_stride));
+            view.mode = "ATTRIBUTES";
+        }
+        encoded.shrink_to_fit();
+        view.data = encoded.data();
+        view.bin_length = encoded.size();
+        p_compressed.push_back(std::move(encoded));
+    }
+    p_buffer_views.push_back(view);
+
+    if (component_type == Short)
+    {
+        p_has_quantization = true;
+    }
+
+    // elements are padded to 4 bytes, so uncompressed views stays aligned without padding
+    p_buffer_size += byte_length;
+    p_bin_size += pad4(view.bin_length);
+
+    Accessor accessor;
+    accessor.component_type = component_type;
+    accessor.type = type;
+    accessor.count = count;
+    accessor.components = components;
+    accessor.has_min_max = min_values != nullptr && max_values != nullptr;
+    if (accessor.has_min_max)
+    {
+        std::memcpy(accessor.min_values, min_values, accessor.components * sizeof(double));
+        std::memcpy(accessor.max_values, max_values, accessor.components * sizeof(double));
+    }
+    p_accessors.push_back(accessor);
+
+    return static_cast<int>(p_accessors.size() - 1);
+}
+
+int GlbWriter::add_material(uint32_t color)
+{
+    p_materials.push_back(color);
+    return static_cast<int>(p_materials.size() - 1);
+}
+
+int GlbWriter::add_mesh_node(int indices, int positions, int material, int translation, int rotation, int scale)
+{
+    MeshNode node;
+    node.indices = indices;
+    node.positions = positions;
+    node.material = material;
+    node.translation = translation;
+    node.rotation = rotation;
+    node.scale = scale;
+    node.has_transform = false;
+    p_nodes.push_back(node);
+
+    if (translation >= 0)
+    {
+        p_has_instancing = true;
+    }
+
+    return static_cast<int>(p_nodes.size() - 1);
+}
+
+void GlbWriter::set_node_transform(int node, const double *translation, double scale)
+{
+    auto &mesh_node = p_nodes[node];
+    mesh_node.has_transform = true;
+    for (int i = 0; i < 3; i++)
+    {
+        mesh_node.local_origin[i] = translation[i];
+    }
+    mesh_node.local_scale = scale;
+}
+
+void GlbWriter::write_json(rapidjson::Writer<rapidjson::StringBuffer> &writer)
+{
+    writer.StartObject();
+
+    writer.Key("asset");
+    writer.StartObject();
+    writer.Key("version");
+    writer.String("2.0");
+    writer.Key("generator");
+    writer.String("rvm_parser");
+    writer.Key("extras");
+    writer.StartObject();
+    writer.Key("web3dversion");
+    writer.Int(2);
+    writer.EndObject();
+    writer.EndObject();
+
+    // both are required, viewer cant show anything without them
+    std::vector<const char *> extensions;
+    if (p_has_instancing)
+    {
+        extensions.push_back("EXT_mesh_gpu_instancing");
+    }
+    if (p_compression == Compression::meshopt)
+    {
+        extensions.push_back("EXT_meshopt_compression");
+    }
+    if (p_has_quantization)
+    {
+        extensions.push_back("KHR_mesh_quantization");
+    }
+    if (!extensions.empty())
+    {
+        for (auto *key : {"extensionsUsed", "extensionsRequired"})
+        {
+            writer.Key(key);
+            writer.StartArray();
+            for (auto *extension : extensions)
+            {
+                writer.String(extension);
+            }
+            writer.EndArray();
+        }
+    }
+
+    writer.Key("scenes");
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("nodes");
+    writer.StartArray();
+    for (size_t i = 0; i < p_nodes.size(); i++)
+    {
+        writer.Uint(static_cast<unsigned>(i));
+    }
+    writer.EndArray();
+    writer.Key("extras");
+    writer.RawValue(p_extras_buffer.GetString(), p_extras_buffer.GetSize(), rapidjson::kObjectType);
+    writer.EndObject();
+    writer.EndArray();
+
+    // 1 mesh per node, so mesh and node index is the same
+    writer.Key("nodes");
+    writer.StartArray();
+    for (size_t i = 0; i < p_nodes.size(); i++)
+    {
+        auto &node = p_nodes[i];
+        auto name = std::string("node") + std::to_string(i);
+        writer.StartObject();
+        writer.Key("mesh");
+        writer.Uint(static_cast<unsigned>(i));
+        writer.Key("name");
+        writer.String(name.c_str(), static_cast<rapidjson::SizeType>(name.length()));
+        if (node.has_transform)
+        {
+            writer.Key("translation");
+            writer.StartArray();
+            for (auto t : node.local_origin)
+            {
+                writer.Double(t);
+            }
+            writer.EndArray();
+            if (node.local_scale != 1.0)
+            {
+                writer.Key("scale");
+                writer.StartArray();
+                for (int i = 0; i < 3; i++)
+                {
+                    writer.Double(node.local_scale);
+                }
+                writer.EndArray();
+            }
+        }
+        if (node.translation >= 0)
+        {
+            writer.Key("extensions");
+            writer.StartObject();
+            writer.Key("EXT_mesh_gpu_instancing");
+            writer.StartObject();
+            writer.Key("attributes");
+            writer.StartObject();
+            writer.Key("TRANSLATION");
+            writer.Int(node.translation);
+            writer.Key("ROTATION");
+            writer.Int(node.rotation);
+            writer.Key("SCALE");
+            writer.Int(node.scale);
+            writer.EndObject();
+            writer.EndObject();
+            writer.EndObject();
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("meshes");
+    writer.StartArray();
+    for (auto &node : p_nodes)
+    {
+        writer.StartObject();
+        writer.Key("primitives");
+        writer.StartArray();
+        writer.StartObject();
+        writer.Key("attributes");
+        writer.StartObject();
+        writer.Key("POSITION");
+        writer.Int(node.positions);
+        writer.EndObject();
+        writer.Key("indices");
+        writer.Int(node.indices);
+        writer.Key("material");
+        writer.Int(node.material);
+        writer.Key("mode");
+        writer.Int(4); // triangles
+        writer.EndObject();
+        writer.EndArray();
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("materials");
+    writer.StartArray();
+    for (auto color : p_materials)
+    {
+        double base_color[4] = {
+            (1.f / 255.f) * ((color >> 16) & 0xff),
+            (1.f / 255.f) * ((color >> 8) & 0xff),
+            (1.f / 255.f) * ((color) & 0xff),
+            (1.f / 255.f) * ((color >> 24) & 0xff)};
+
+        writer.StartObject();
+        if (base_color[3] != 1)
+        {
+            writer.Key("alphaMode");
+            writer.String("BLEND");
+            base_color[3] = 1.0 - base_color[3];
+        }
+        writer.Key("doubleSided");
+        writer.Bool(true);
+        writer.Key("pbrMetallicRoughness");
+        writer.StartObject();
+        writer.Key("baseColorFactor");
+        writer.StartArray();
+        for (auto c : base_color)
+        {
+            writer.Double(c);
+        }
+        writer.EndArray();
+        writer.Key("metallicFactor");
+        writer.Double(0.0);
+        writer.Key("roughnessFactor");
+        writer.Double(1.0);
+        writer.EndObject();
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    // 1 buffer view per accessor
+    writer.Key("accessors");
+    writer.StartArray();
+    for (size_t i = 0; i < p_accessors.size(); i++)
+    {
+        auto &accessor = p_accessors[i];
+        writer.StartObject();
+        writer.Key("bufferView");
+        writer.Uint(static_cast<unsigned>(i));
+        writer.Key("componentType");
+        writer.Int(accessor.component_type);
+        writer.Key("count");
+        writer.Uint64(accessor.count);
+        writer.Key("type");
+        writer.String(accessor.type);
+        if (accessor.has_min_max)
+        {
+            // integer accessors gets integer bounds
+            const char *keys[2] = {"min", "max"};
+            const double *values[2] = {accessor.min_values, accessor.max_values};
+            for (int k = 0; k < 2; k++)
+            {
+                writer.Key(keys[k]);
+                writer.StartArray();
+                for (unsigned c = 0; c < accessor.components; c++)
+                {
+                    if (accessor.component_type == Float)
+                    {
+                        writer.Double(values[k][c]);
+                    }
+                    else
+                    {
+                        writer.Int64(static_cast<int64_t>(values[k][c]));
+                    }
+                }
+                writer.EndArray();
+            }
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    // compressed views points into fallback buffer 1 that has no data, real data is in extension
+    writer.Key("bufferViews");
+    writer.StartArray();
+    for (auto &view : p_buffer_views)
+    {
+        writer.StartObject();
+        writer.Key("buffer");
+        writer.Int(view.mode != nullptr ? 1 : 0);
+        if (view.byte_offset > 0)
+        {
+            writer.Key("byteOffset");
+            writer.Uint64(view.byte_offset);
+        }
+        writer.Key("byteLength");
+        writer.Uint64(view.byte_length);
+        if (view.padded)
+        {
+            writer.Key("byteStride");
+            writer.Uint(view.byte_stride);
+        }
+        if (view.target != NoTarget)
+        {
+            writer.Key("target");
+            writer.Int(view.target);
+        }
+        if (view.mode != nullptr)
+        {
+            writer.Key("extensions");
+            writer.StartObject();
+            writer.Key("EXT_meshopt_compression");
+            writer.StartObject();
+            writer.Key("buffer");
+            writer.Int(0);
+            if (view.bin_offset > 0)
+            {
+                writer.Key("byteOffset");
+                writer.Uint64(view.bin_offset);
+            }
+            writer.Key("byteLength");
+            writer.Uint64(view.bin_length);
+            writer.Key("byteStride");
+            writer.Uint(view.byte_stride);
+            writer.Key("count");
+            writer.Uint64(view.count);
+            writer.Key("mode");
+            writer.String(view.mode);
+            writer.EndObject();
+            writer.EndObject();
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("buffers");
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("byteLength");
+    writer.Uint64(p_bin_size);
+    writer.EndObject();
+    if (p_compression == Compression::meshopt)
+    {
+        writer.StartObject();
+        writer.Key("byteLength");
+        writer.Uint64(p_buffer_size);
+        writer.Key("extensions");
+        writer.StartObject();
+        writer.Key("EXT_meshopt_compression");
+        writer.StartObject();
+        writer.Key("fallback");
+        writer.Bool(true);
+        writer.EndObject();
+        writer.EndObject();
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.EndObject();
+}
+
+bool GlbWriter::write(const std::string &file_name)
+{
+    p_extras.EndObject();
+
+    rapidjson::StringBuffer json;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(json);
+    write_json(writer);
+
+    // chunks must be 4 byte aligned, json is padded with spaces and bin with zeros
+    size_t json_length = pad4(json.GetSize());
+    size_t bin_length = p_bin_size;
+    size_t total_length = 12 + 8 + json_length + 8 + bin_length;
+
+    std::ofstream file;
+    file.open(file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed writing to file: " << file_name << std::endl;
+        return false;
+    }
+
+    write_u32(file, glb_magic);
+    write_u32(file, glb_version);
+    write_u32(file, static_cast<uint32_t>(total_length));
+
+    write_u32(file, static_cast<uint32_t>(json_length));
+    write_u32(file, chunk_json);
+    file.write(json.GetString(), json.GetSize());
+    file.write("   ", json_length - json.GetSize());
+
+    write_u32(file, static_cast<uint32_t>(bin_length));
+    write_u32(file, chunk_bin);
+    // each view is padded, so next one starts 4 byte aligned
+    const char zeros[4] = {0, 0, 0, 0};
+    for (auto &view : p_buffer_views)
+    {
+        file.write(reinterpret_cast<const char *>(view.data), view.bin_length);
+        file.write(zeros, pad4(view.bin_length) - view.bin_length);
+    }
+
+    file.close();
+    if (file.fail())
+    {
+        std::cerr << "Failed writing to file: " << file_name << std::endl;
+        return false;
+    }
+
+    return true;
+}
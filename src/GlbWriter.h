@@ -0,0 +1,139 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rapidjson/include/stringbuffer.h"
+#include "rapidjson/include/writer.h"
+
+enum struct Compression : uint8_t
+{
+    none,
+    meshopt, // EXT_meshopt_compression
+};
+
+/**
+ * Writes a binary glTF file without building a full model in memory first
+ * Buffer views only point at the data, so geometry is not copied into one big buffer. Data must stay
+ * alive until write, arrays that would go out of scope can be moved into writer instead.
+ * Json chunk is written compact with rapidjson, followed by the buffer views streamed into the BIN chunk
+ * With meshopt compression each buffer view is encoded when added, and the data is not needed after that
+ */
+class GlbWriter
+{
+public:
+    enum ComponentType : int
+    {
+        Short = 5122, // only for positions, see KHR_mesh_quantization
+        UnsignedInt = 5125,
+        Float = 5126,
+    };
+
+    enum Target : int
+    {
+        NoTarget = 0,
+        ArrayBuffer = 34962,
+        ElementArrayBuffer = 34963,
+    };
+
+    explicit GlbWriter(Compression compression = Compression::none);
+
+    // adds data with its own buffer view, type is SCALAR, VEC3 etc, min/max can be nullptr. Returns accessor index
+    // data must stay alive until write, unless it is compressed
+    int add_accessor(const void *data, size_t byte_length, ComponentType component_type, const char *type, size_t count, Target target, const double *min_values, const double *max_values);
+
+    // same as above, but writer takes data so it lives until write
+    template <typename T>
+    int add_accessor(std::vector<T> &&data, ComponentType component_type, const char *type, size_t count, Target target, const double *min_values, const double *max_values)
+    {
+        auto byte_length = data.size() * sizeof(T);
+        if (p_compression != Compression::none)
+        {
+            return add_accessor(data.data(), byte_length, component_type, type, count, target, min_values, max_values);
+        }
+        auto kept = std::make_shared<std::vector<T>>(std::move(data));
+        p_kept.push_back(kept);
+        return add_accessor(kept->data(), byte_length, component_type, type, count, target, min_values, max_values);
+    }
+
+    int add_material(uint32_t color);
+
+    // adds mesh with 1 triangle primitive and node using it, translation/rotation/scale >= 0 adds EXT_mesh_gpu_instancing
+    // returns node index
+    int add_mesh_node(int indices, int positions, int material, int translation = -1, int rotation = -1, int scale = -1);
+
+    // places node at translation with uniform scale, used for local origin and dequantization of positions
+    void set_node_transform(int node, const double *translation, double scale);
+
+    // scene extras object, caller adds members to it, writer closes it
+    rapidjson::Writer<rapidjson::StringBuffer> &extras() { return p_extras; }
+
+    size_t buffer_size() const { return p_buffer_size; }
+
+    // returns false if file could not be written
+    bool write(const std::string &file_name);
+
+private:
+    struct BufferView
+    {
+        const void *data;
+        size_t byte_offset;
+        size_t byte_length;
+        Target target;
+
+        // where data is in BIN chunk, same as byte_offset/byte_length when not compressed
+        size_t bin_offset;
+        size_t bin_length;
+
+        // EXT_meshopt_compression mode (ATTRIBUTES or TRIANGLES), nullptr when not compressed
+        const char *mode;
+        unsigned byte_stride;
+        size_t count;
+
+        // elements are padded, so stride must be written
+        bool padded;
+    };
+
+    struct Accessor
+    {
+        ComponentType component_type;
+        const char *type;
+        size_t count;
+        unsigned components;
+        double min_values[4];
+        double max_values[4];
+        bool has_min_max;
+    };
+
+    struct MeshNode
+    {
+        int indices;
+        int positions;
+        int material;
+        int translation;
+        int rotation;
+        int scale;
+
+        bool has_transform;
+        double local_origin[3];
+        double local_scale;
+    };
+
+    std::vector<BufferView> p_buffer_views;
+    std::vector<Accessor> p_accessors;
+    std::vector<uint32_t> p_materials;
+    std::vector<MeshNode> p_nodes;
+    std::vector<std::shared_ptr<const void>> p_kept;
+    std::vector<std::vector<unsigned char>> p_compressed;
+    size_t p_buffer_size = 0;
+    size_t p_bin_size = 0;
+    bool p_has_instancing = false;
+    bool p_has_quantization = false;
+    Compression p_compression = Compression::none;
+
+    rapidjson::StringBuffer p_extras_buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> p_extras;
+
+    void write_json(rapidjson::Writer<rapidjson::StringBuffer> &writer);
+};
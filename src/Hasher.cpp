@@ -0,0 +1,195 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "Hasher.h"
+
+namespace
+{
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    inline uint64_t rotl64(uint64_t x, int8_t r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t fmix64(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    inline uint64_t load_uint64_le(const uint8_t *p)
+    {
+        uint64_t v = 0;
+        for (int i = 7; i >= 0; i--)
+        {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+}
+
+void Hasher::set_type(HashType type)
+{
+    p_type = type;
+    reset();
+}
+
+const char *Hasher::get_type_name() const
+{
+    return p_type == HashType::murmur3 ? "murmur3" : "md5";
+}
+
+void Hasher::reset()
+{
+    MD5 new_ctx;
+    p_md5 = new_ctx;
+
+    p_h1 = 0;
+    p_h2 = 0;
+    p_length = 0;
+    p_tail_length = 0;
+}
+
+void Hasher::murmur3_block(const uint8_t *block)
+{
+    uint64_t k1 = load_uint64_le(block);
+    uint64_t k2 = load_uint64_le(block + 8);
+
+    k1 *= c1;
+    k1 = rotl64(k1, 31);
+    k1 *= c2;
+    p_h1 ^= k1;
+
+    p_h1 = rotl64(p_h1, 27);
+    p_h1 += p_h2;
+    p_h1 = p_h1 * 5 + 0x52dce729;
+
+    k2 *= c2;
+    k2 = rotl64(k2, 33);
+    k2 *= c1;
+    p_h2 ^= k2;
+
+    p_h2 = rotl64(p_h2, 31);
+    p_h2 += p_h1;
+    p_h2 = p_h2 * 5 + 0x38495ab5;
+}
+
+void Hasher::update(const uint8_t *data, size_t length)
+{
+    if (p_type == HashType::md5)
+    {
+        // md5 only takes 32 bit length
+        const size_t max_span = 1u << 30;
+        while (length > 0)
+        {
+            auto span = length < max_span ? length : max_span;
+            p_md5.update(data, static_cast<MD5::size_type>(span));
+            data += span;
+            length -= span;
+        }
+        return;
+    }
+
+    p_length += length;
+
+    // fill up tail from last update first
+    if (p_tail_length > 0)
+    {
+        auto needed = 16 - p_tail_length;
+        auto n = length < needed ? length : needed;
+        std::memcpy(p_tail + p_tail_length, data, n);
+        p_tail_length += n;
+        data += n;
+        length -= n;
+
+        if (p_tail_length < 16)
+        {
+            return;
+        }
+
+        murmur3_block(p_tail);
+        p_tail_length = 0;
+    }
+
+    while (length >= 16)
+    {
+        murmur3_block(data);
+        data += 16;
+        length -= 16;
+    }
+
+    std::memcpy(p_tail, data, length);
+    p_tail_length = length;
+}
+
+std::string Hasher::hexdigest()
+{
+    if (p_type == HashType::md5)
+    {
+        p_md5.finalize();
+        return p_md5.hexdigest();
+    }
+
+    uint64_t h1 = p_h1;
+    uint64_t h2 = p_h2;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    for (size_t i = p_tail_length; i > 8; i--)
+    {
+        k2 = (k2 << 8) | p_tail[i - 1];
+    }
+    for (size_t i = p_tail_length < 8 ? p_tail_length : 8; i > 0; i--)
+    {
+        k1 = (k1 << 8) | p_tail[i - 1];
+    }
+
+    if (p_tail_length > 8)
+    {
+        k2 *= c2;
+        k2 = rotl64(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+    }
+    if (p_tail_length > 0)
+    {
+        k1 *= c1;
+        k1 = rotl64(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+    }
+
+    h1 ^= p_length;
+    h2 ^= p_length;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    // same byte order as reference implementation writing h1, h2 to memory
+    const char hex[] = "0123456789abcdef";
+    std::string digest;
+    digest.reserve(32);
+    for (auto h : {h1, h2})
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            uint8_t b = (h >> (8 * i)) & 0xff;
+            digest += hex[b >> 4];
+            digest += hex[b & 0xf];
+        }
+    }
+
+    return digest;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include "md5.h"
+
+enum struct HashType : uint8_t
+{
+    md5 = 0,
+    murmur3 = 1,
+};
+
+/**
+ * Hash used for change detection of root elements (md5 in status file)
+ * md5 is default so old status files still match
+ * murmur3 (x64 128 bit) is a lot faster, but not cryptographic
+ */
+class Hasher
+{
+
+public:
+    Hasher() = default;
+
+    void set_type(HashType type);
+    HashType get_type() const { return p_type; }
+    const char *get_type_name() const;
+
+    void reset();
+    void update(const uint8_t *data, size_t length);
+    std::string hexdigest();
+
+private:
+    HashType p_type = HashType::md5;
+
+    MD5 p_md5;
+
+    // murmur3 state, bytes not filling a 16 byte block is kept in tail until next update
+    uint64_t p_h1 = 0;
+    uint64_t p_h2 = 0;
+    uint64_t p_length = 0;
+    uint8_t p_tail[16];
+    size_t p_tail_length = 0;
+
+    void murmur3_block(const uint8_t *block);
+};
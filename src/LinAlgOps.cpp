@@ -5,6 +5,13 @@
 
 #include "LinAlgOps.h"
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LINALG_SSE2
+#endif
+
 Mat3f inverse(const Mat3f &M)
 {
     const Vec3f &c0 = M.cols[0];
@@ -82,3 +89,132 @@ BBox3f transform(const Mat3x4f &M, const BBox3f &bbox)
     return makeBBox3f(min(min(min(p[0], p[1]), min(p[2], p[3])), min(min(p[4], p[5]), min(p[6], p[7]))),
                       max(max(max(p[0], p[1]), max(p[2], p[3])), max(max(p[4], p[5]), max(p[6], p[7]))));
 }
+
+Mat3x4d zUpToYUp(const Mat3x4d &M)
+{
+    Mat3x4d r;
+    for (size_t c = 0; c < 4; c++)
+    {
+        r.data[3 * c + 0] = M.data[3 * c + 0];
+        r.data[3 * c + 1] = M.data[3 * c + 2];
+        r.data[3 * c + 2] = -M.data[3 * c + 1];
+    }
+    return r;
+}
+
+#if defined(__AVX__)
+
+// one position per iteration, x y z in the lower 3 of 4 doubles
+BBox3f transformPositions(const Mat3x4d &M, const float *src, float *dst, size_t count)
+{
+    const __m256d c0 = _mm256_setr_pd(M.data[0], M.data[1], M.data[2], 0.0);
+    const __m256d c1 = _mm256_setr_pd(M.data[3], M.data[4], M.data[5], 0.0);
+    const __m256d c2 = _mm256_setr_pd(M.data[6], M.data[7], M.data[8], 0.0);
+    const __m256d c3 = _mm256_setr_pd(M.data[9], M.data[10], M.data[11], 0.0);
+
+    __m128 lo = _mm_set1_ps(FLT_MAX);
+    __m128 hi = _mm_set1_ps(-FLT_MAX);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const float *p = src + 3 * i;
+        __m256d r = _mm256_mul_pd(c0, _mm256_set1_pd(p[0]));
+        r = _mm256_add_pd(r, _mm256_mul_pd(c1, _mm256_set1_pd(p[1])));
+        r = _mm256_add_pd(r, _mm256_mul_pd(c2, _mm256_set1_pd(p[2])));
+        r = _mm256_add_pd(r, c3);
+        __m128 f = _mm256_cvtpd_ps(r);
+
+        // min/max returns second operand when one is nan
+        lo = _mm_min_ps(f, lo);
+        hi = _mm_max_ps(f, hi);
+
+        float *q = dst + 3 * i;
+        _mm_storel_pi(reinterpret_cast<__m64 *>(q), f);
+        _mm_store_ss(q + 2, _mm_movehl_ps(f, f));
+    }
+
+    alignas(16) float l[4];
+    alignas(16) float h[4];
+    _mm_store_ps(l, lo);
+    _mm_store_ps(h, hi);
+    return makeBBox3f(makeVec3f(l[0], l[1], l[2]), makeVec3f(h[0], h[1], h[2]));
+}
+
+#elif defined(LINALG_SSE2)
+
+// one position per iteration, x y in one register and z in another
+BBox3f transformPositions(const Mat3x4d &M, const float *src, float *dst, size_t count)
+{
+    const __m128d c0xy = _mm_setr_pd(M.data[0], M.data[1]);
+    const __m128d c1xy = _mm_setr_pd(M.data[3], M.data[4]);
+    const __m128d c2xy = _mm_setr_pd(M.data[6], M.data[7]);
+    const __m128d c3xy = _mm_setr_pd(M.data[9], M.data[10]);
+    const __m128d cz = _mm_setr_pd(M.data[2], M.data[5]);
+    const __m128d c2z = _mm_set_sd(M.data[8]);
+    const __m128d c3z = _mm_set_sd(M.data[11]);
+
+    __m128 lo = _mm_set1_ps(FLT_MAX);
+    __m128 hi = _mm_set1_ps(-FLT_MAX);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const float *p = src + 3 * i;
+        const __m128d x = _mm_set1_pd(p[0]);
+        const __m128d y = _mm_set1_pd(p[1]);
+        const __m128d z = _mm_set1_pd(p[2]);
+
+        __m128d xy = _mm_mul_pd(c0xy, x);
+        xy = _mm_add_pd(xy, _mm_mul_pd(c1xy, y));
+        xy = _mm_add_pd(xy, _mm_mul_pd(c2xy, z));
+        xy = _mm_add_pd(xy, c3xy);
+
+        // z row: m20 * x + m21 * y in both lanes, then summed in lane 0
+        __m128d zz = _mm_mul_pd(cz, _mm_unpacklo_pd(x, y));
+        __m128d rz = _mm_add_sd(zz, _mm_unpackhi_pd(zz, zz));
+        rz = _mm_add_sd(rz, _mm_mul_sd(c2z, z));
+        rz = _mm_add_sd(rz, c3z);
+
+        __m128 f = _mm_movelh_ps(_mm_cvtpd_ps(xy), _mm_cvtpd_ps(rz));
+
+        // min/max returns second operand when one is nan
+        lo = _mm_min_ps(f, lo);
+        hi = _mm_max_ps(f, hi);
+
+        float *q = dst + 3 * i;
+        _mm_storel_pi(reinterpret_cast<__m64 *>(q), f);
+        _mm_store_ss(q + 2, _mm_movehl_ps(f, f));
+    }
+
+    alignas(16) float l[4];
+    alignas(16) float h[4];
+    _mm_store_ps(l, lo);
+    _mm_store_ps(h, hi);
+    return makeBBox3f(makeVec3f(l[0], l[1], l[2]), makeVec3f(h[0], h[1], h[2]));
+}
+
+#else
+
+BBox3f transformPositions(const Mat3x4d &M, const float *src, float *dst, size_t count)
+{
+    BBox3f bbox = createEmptyBBox3f();
+    for (size_t i = 0; i < count; i++)
+    {
+        auto a = makeVec3f(mul(M, makeVec3d(src + 3 * i)));
+        write(dst + 3 * i, a);
+
+        for (size_t k = 0; k < 3; k++)
+        {
+            if (a.data[k] < bbox.min.data[k])
+            {
+                bbox.min.data[k] = a.data[k];
+            }
+            if (a.data[k] > bbox.max.data[k])
+            {
+                bbox.max.data[k] = a.data[k];
+            }
+        }
+    }
+    return bbox;
+}
+
+#endif
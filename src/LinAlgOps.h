@@ -124,6 +124,14 @@ inline void engulf(BBox3f &target, const BBox3f &other)
 
 BBox3f transform(const Mat3x4f &M, const BBox3f &bbox);
 
+// dst = M * src for count positions (xyz after each other), dst can be src
+// sums are done in double in same order as mul(Mat3x4d, Vec3d), so result is the same on all paths
+// returns bbox of dst, nan coordinates are left out
+BBox3f transformPositions(const Mat3x4d &M, const float *src, float *dst, size_t count);
+
+// M followed by rotation from rvm Z up to glTF Y up, (x, y, z) -> (x, z, -y)
+Mat3x4d zUpToYUp(const Mat3x4d &M);
+
 inline float diagonal(const BBox3f &b) { return distance(b.min, b.max); }
 
 inline bool isEmpty(const BBox3f &b) { return b.max.x < b.min.x; }
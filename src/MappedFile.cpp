@@ -0,0 +1,120 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::string &filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (map == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    auto view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        CloseHandle(map);
+        CloseHandle(file);
+        return false;
+    }
+
+    p_file_handle = file;
+    p_map_handle = map;
+    p_data = static_cast<const uint8_t *>(view);
+    p_size = static_cast<size_t>(file_size.QuadPart);
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0 || stat_buf.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    auto size = static_cast<size_t>(stat_buf.st_size);
+    auto view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // we walk the file front to back, let the kernel read ahead and drop pages behind us
+    madvise(view, size, MADV_SEQUENTIAL);
+
+    p_fd = fd;
+    p_data = static_cast<const uint8_t *>(view);
+    p_size = size;
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (p_data != nullptr)
+    {
+        UnmapViewOfFile(p_data);
+    }
+    if (p_map_handle != nullptr)
+    {
+        CloseHandle(p_map_handle);
+    }
+    if (p_file_handle != nullptr)
+    {
+        CloseHandle(p_file_handle);
+    }
+    p_map_handle = nullptr;
+    p_file_handle = nullptr;
+#else
+    if (p_data != nullptr)
+    {
+        munmap(const_cast<uint8_t *>(p_data), p_size);
+    }
+    if (p_fd >= 0)
+    {
+        ::close(p_fd);
+    }
+    p_fd = -1;
+#endif
+
+    p_data = nullptr;
+    p_size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * Read only view of a whole file
+ * Uses mmap (file mapping on windows), so the parser can decode directly from memory
+ * and we dont need to copy everything through a small read buffer
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    bool open(const std::string &filename);
+    void close();
+
+    const uint8_t *data() const { return p_data; }
+    size_t size() const { return p_size; }
+
+private:
+    const uint8_t *p_data = nullptr;
+    size_t p_size = 0;
+
+#ifdef _WIN32
+    void *p_file_handle = nullptr;
+    void *p_map_handle = nullptr;
+#else
+    int p_fd = -1;
+#endif
+};
@@ -0,0 +1,120 @@
+#include <cmath>
+#include "PositionWelder.h"
+
+namespace
+{
+    inline uint64_t mix64(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    inline uint64_t hash_key(const int64_t *key)
+    {
+        uint64_t h = mix64(static_cast<uint64_t>(key[0]));
+        h = mix64(h ^ static_cast<uint64_t>(key[1]));
+        return mix64(h ^ static_cast<uint64_t>(key[2]));
+    }
+}
+
+void PositionWelder::reset(size_t expected_count, uint8_t precision)
+{
+    // same scaling as we always had, 326.676605 will be 326677 with precision 3
+    p_scale = static_cast<float>(static_cast<int>(std::pow(10, precision)));
+
+    // keep table at most half full
+    size_t slot_count = 16;
+    while (slot_count < 2 * expected_count)
+    {
+        slot_count *= 2;
+    }
+
+    p_slots.resize(slot_count);
+    for (auto &slot : p_slots)
+    {
+        slot.index = empty_slot;
+    }
+    p_mask = slot_count - 1;
+
+    p_positions.clear();
+    p_positions.reserve(3 * expected_count);
+}
+
+int64_t PositionWelder::quantize(float value) const
+{
+    float scaled = std::round(value * p_scale);
+
+    // nan gets a key of its own, so it never merges with a real position
+    if (std::isnan(scaled))
+    {
+        return INT64_MIN;
+    }
+    if (scaled >= 9.2e18f)
+    {
+        return INT64_MAX;
+    }
+    if (scaled <= -9.2e18f)
+    {
+        return INT64_MIN + 1;
+    }
+    return static_cast<int64_t>(scaled);
+}
+
+uint32_t PositionWelder::weld(const float *position)
+{
+    int64_t key[3] = {quantize(position[0]), quantize(position[1]), quantize(position[2])};
+
+    // grow if someone added more than expected
+    if (2 * (size() + 1) > p_slots.size())
+    {
+        std::vector<Slot> old_slots;
+        old_slots.swap(p_slots);
+        p_slots.resize(2 * old_slots.size());
+        for (auto &slot : p_slots)
+        {
+            slot.index = empty_slot;
+        }
+        p_mask = p_slots.size() - 1;
+
+        for (auto &slot : old_slots)
+        {
+            if (slot.index == empty_slot)
+            {
+                continue;
+            }
+            auto i = hash_key(slot.key) & p_mask;
+            while (p_slots[i].index != empty_slot)
+            {
+                i = (i + 1) & p_mask;
+            }
+            p_slots[i] = slot;
+        }
+    }
+
+    auto i = hash_key(key) & p_mask;
+    while (p_slots[i].index != empty_slot)
+    {
+        auto &slot = p_slots[i];
+        if (slot.key[0] == key[0] && slot.key[1] == key[1] && slot.key[2] == key[2])
+        {
+            return slot.index;
+        }
+        i = (i + 1) & p_mask;
+    }
+
+    auto index = size();
+    p_slots[i].key[0] = key[0];
+    p_slots[i].key[1] = key[1];
+    p_slots[i].key[2] = key[2];
+    p_slots[i].index = index;
+
+    p_positions.push_back(position[0]);
+    p_positions.push_back(position[1]);
+    p_positions.push_back(position[2]);
+
+    return index;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Merges positions that are equal after rounding to precision decimals
+ * Rounded coordinates are kept as 64 bit integers, so large site coordinates does not overflow
+ * Lookup is a open addressing table, reset keeps its memory so it can be used for every node
+ */
+class PositionWelder
+{
+public:
+    PositionWelder() = default;
+
+    // clears positions, expected_count is number of positions we will try to add
+    void reset(size_t expected_count, uint8_t precision);
+
+    // returns index of position, position is added if we have not seen it before
+    uint32_t weld(const float *position);
+
+    const std::vector<float> &positions() const { return p_positions; }
+    uint32_t size() const { return static_cast<uint32_t>(p_positions.size() / 3); }
+
+private:
+    static const uint32_t empty_slot = UINT32_MAX;
+
+    struct Slot
+    {
+        int64_t key[3];
+        uint32_t index;
+    };
+
+    std::vector<Slot> p_slots;
+    size_t p_mask = 0;
+    float p_scale = 1000.f;
+
+    // first position we saw for each key
+    std::vector<float> p_positions;
+
+    int64_t quantize(float value) const;
+};
@@ -4,11 +4,11 @@
 #include <vector>
 #include <array>
 #include <set>
-#include <fstream>
+#include <algorithm>
 #include <iostream>
 #include <chrono>
-#define _FILE_OFFSET_BITS 64
-#include <sys/stat.h>
+#include <limits>
+#include <filesystem>
 #include "Arena.h"
 #include "RvmParser.h"
 #include "Geometry.h"
@@ -19,7 +19,80 @@
 #include "../libs/rapidjson/include/document.h"
 #include "../libs/rapidjson/include/stringbuffer.h"
 #include "../libs/rapidjson/include/writer.h"
-#include "md5.h"
+#include "Hasher.h"
+
+RvmParser::~RvmParser()
+{
+    delete arenaTriangulation;
+}
+
+namespace
+{
+    // simple wildcard match, * is any number of chars and ? is 1 char
+    bool match_pattern(const std::string &pattern, const std::string &name)
+    {
+        size_t p = 0;
+        size_t n = 0;
+        size_t star = std::string::npos;
+        size_t star_n = 0;
+
+        while (n < name.length())
+        {
+            if (p < pattern.length() && (pattern[p] == '?' || pattern[p] == name[n]))
+            {
+                p++;
+                n++;
+            }
+            else if (p < pattern.length() && pattern[p] == '*')
+            {
+                star = p++;
+                star_n = n;
+            }
+            else if (star != std::string::npos)
+            {
+                p = star + 1;
+                n = ++star_n;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        while (p < pattern.length() && pattern[p] == '*')
+        {
+            p++;
+        }
+
+        return p == pattern.length();
+    }
+}
+
+bool RvmParser::is_root_included(const std::string &name) const
+{
+    for (const auto &pattern : p_exclude_roots)
+    {
+        if (match_pattern(pattern, name))
+        {
+            return false;
+        }
+    }
+
+    if (p_include_roots.empty())
+    {
+        return true;
+    }
+
+    for (const auto &pattern : p_include_roots)
+    {
+        if (match_pattern(pattern, name))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
 
 std::string RvmParser::get_file_name()
 {
@@ -57,7 +130,22 @@ int RvmParser::read_file(
     float tolerance,
     float meshopt_threshold,
     float meshopt_target_error,
-    bool is_dry_run)
+    bool is_dry_run,
+    HashType hash_type,
+    bool use_root_index,
+    unsigned threads,
+    std::vector<std::string> include_roots,
+    std::vector<std::string> exclude_roots,
+    std::string incremental_status_file,
+    bool use_stream,
+    size_t arena_page_size,
+    size_t arena_keep_size,
+    bool arena_huge_pages,
+    size_t tessellation_cache_size,
+    uint32_t instancing_min_count,
+    bool remove_hidden_caps,
+    Compression compression,
+    bool quantize_positions)
 {
     p_export_level = export_level;
     p_remove_elements_without_primitives = remove_elements_without_primitives;
@@ -68,109 +156,99 @@ int RvmParser::read_file(
     p_meshopt_threshold = meshopt_threshold;
     p_meshopt_target_error = meshopt_target_error;
     p_is_dry_run = is_dry_run;
-
-    auto start = std::chrono::high_resolution_clock::now();
-
-    p_buffer_total_length = get_file_size(filename);
-    if (p_buffer_total_length == 0)
+    p_instancing_min_count = instancing_min_count;
+    p_remove_hidden_caps = remove_hidden_caps;
+    p_compression = compression;
+    p_quantize_positions = quantize_positions;
+    p_root_hash.set_type(hash_type);
+    p_use_root_index = use_root_index;
+    p_threads = threads;
+    p_include_roots = include_roots;
+    p_exclude_roots = exclude_roots;
+    p_arena_page_size = arena_page_size;
+    p_arena_keep_size = arena_keep_size;
+    p_arena_huge_pages = arena_huge_pages;
+    configure_arena(p_prim_arena);
+    configure_arena(p_tessellator.cache_arena);
+    configure_arena(p_root_geometry_arena);
+    p_tessellator.use_cache = tessellation_cache_size > 0;
+    p_tessellator.cache_limit = tessellation_cache_size;
+
+    // instances are found through shapes shared by the cache
+    if (p_instancing_min_count > 0 && !p_tessellator.use_cache)
     {
-        std::cout << "file not found or size is 0" << std::endl;
-        return 1;
+        std::cout << "--instancing needs --tess-cache-mb, instancing is not used" << std::endl;
+        p_instancing_min_count = 0;
     }
 
+    if (incremental_status_file.length() > 0 && !read_previous_status_file(incremental_status_file))
     {
-        // quickfix to get all color blocks/update color map
-        file_stream_color_search.open(filename, std::ios_base::binary);
+        std::cout << "Unable to use status file from last run, exporting all roots: " << incremental_status_file << std::endl;
+    }
 
-        //last 10 MB
-        auto temp_buffer_size = 10 * 1024 * 1024;
-        if (p_buffer_total_length < temp_buffer_size)
-        {
-            temp_buffer_size = p_buffer_total_length;
-        }
-        auto temp_buffer = new uint8_t[temp_buffer_size];
+    auto start = std::chrono::high_resolution_clock::now();
 
-        std::streamsize read_size = static_cast<int>(p_buffer_total_length) - temp_buffer_size;
-        file_stream_color_search.seekg(read_size, std::ios::beg);
-        file_stream_color_search.read(reinterpret_cast<char *>(temp_buffer), temp_buffer_size);
-        p_buffer_input_length = file_stream_color_search.gcount();
+    // pipes and fifos cant be mapped
+    std::error_code ec;
+    p_is_streaming = use_stream || filename == "-" || !std::filesystem::is_regular_file(filename, ec);
 
-        for (int i = 0; i <= temp_buffer_size - 31; ++i)
+    if (p_is_streaming)
+    {
+        if (!p_stream.open(filename))
         {
+            std::cout << "file not found" << std::endl;
+            return 1;
+        }
 
-            // COLR
-            uint8_t c = temp_buffer[i];
-            uint8_t o = temp_buffer[i + 4];
-            uint8_t l = temp_buffer[i + 8];
-            uint8_t r = temp_buffer[i + 12];
-
-            // 0001
-            uint8_t n1 = temp_buffer[i + 17];
-            uint8_t n2 = temp_buffer[i + 18];
-            uint8_t n3 = temp_buffer[i + 19];
-            uint8_t n4 = temp_buffer[i + 20];
-
-            if (c != 67 ||
-                o != 79 ||
-                l != 76 ||
-                r != 82 ||
-                n1 != 0 ||
-                n2 != 0 ||
-                n3 != 0 ||
-                n4 != 1)
-            {
-                continue;
-            }
+        p_buffer = nullptr;
+        p_buffer_offset = 0;
+        p_buffer_end = 0;
+        p_buffer_total_length = std::numeric_limits<uint64_t>::max();
 
-            union UintConverter
-            {
-                uint32_t u32;
-                uint8_t b[sizeof(uint32_t)];
-            } version;
+        // these needs to jump around in file
+        if (p_use_root_index || p_threads > 1 || p_previous_filemeta.size() > 0)
+        {
+            std::cout << "Streaming input, --root-index, --threads and --incremental is not used" << std::endl;
+        }
+        p_use_root_index = false;
+        p_threads = 1;
+        p_previous_filemeta.clear();
 
-            union UintConverter2
-            {
-                uint32_t u32;
-                uint8_t b[sizeof(uint32_t)];
-            } index;
-
-            // version
-            version.b[3] = temp_buffer[i + 21];
-            version.b[2] = temp_buffer[i + 22];
-            version.b[1] = temp_buffer[i + 23];
-            version.b[0] = temp_buffer[i + 24];
-
-            // index
-            index.b[3] = temp_buffer[i + 25];
-            index.b[2] = temp_buffer[i + 26];
-            index.b[1] = temp_buffer[i + 27];
-            index.b[0] = temp_buffer[i + 28];
-
-            // rgb
-            uint8_t cr = temp_buffer[i + 29];
-            uint8_t cg = temp_buffer[i + 30];
-            uint8_t cb = temp_buffer[i + 31];
-
-            p_color_store.p_id_hex[index.u32] = (cr << 16) | (cg << 8) | cb;
-
-            std::cout << "Found color index: " << index.u32 << " \tR: " << +cr << " \tG:" << +cg << " \tB:" << +cb << std::endl;
+        // from a pipe, colors at end of file is not known until we get there, roots before them get default colors
+        if (std::filesystem::is_regular_file(filename, ec))
+        {
+            read_trailing_colors_from_file(filename);
         }
 
-        file_stream_color_search.close();
+        std::cout << "Stream found, starting to read" << std::endl;
     }
+    else
+    {
+        if (!p_file.open(filename))
+        {
+            std::cout << "file not found or size is 0" << std::endl;
+            return 1;
+        }
 
-    file_stream.open(filename, std::ios_base::binary);
-
-    // return p_buffer_input_length;
+        p_buffer = p_file.data();
+        p_buffer_offset = 0;
+        p_buffer_end = p_file.size();
+        p_buffer_total_length = p_file.size();
 
-    std::cout << "File found, starting to read" << std::endl;
+        if (p_use_root_index)
+        {
+            init_root_index(filename);
+        }
 
-    p_buffer = new uint8_t[p_buffer_size];
+        read_trailing_colors();
 
-    read_next_chunk();
+        std::cout << "File found, starting to read" << std::endl;
+    }
 
     auto result = start_reading();
-    delete p_buffer;
+    p_file.close();
+    p_stream.close();
+    p_buffer = nullptr;
 
     generate_status_file();
 
@@ -181,20 +259,11 @@ int RvmParser::read_file(
     return 0;
 }
 
-uint32_t RvmParser::read_next_chunk()
+void RvmParser::configure_arena(Arena &arena) const
 {
-
-    file_stream.read(reinterpret_cast<char *>(p_buffer), p_buffer_size);
-    p_buffer_input_length = file_stream.gcount();
-
-    return p_buffer_input_length;
-}
-
-uint32_t RvmParser::get_file_size(std::string filename)
-{
-    struct stat stat_buf;
-    int rc = stat(filename.c_str(), &stat_buf);
-    return rc == 0 ? stat_buf.st_size : -1;
+    arena.page_size = p_arena_page_size;
+    arena.keep_size = p_arena_keep_size;
+    arena.huge_pages = p_arena_huge_pages;
 }
 
 void RvmParser::store_last_node()
@@ -203,9 +272,11 @@ void RvmParser::store_last_node()
     if (p_node_count_id > 0)
     {
 
-        std::vector<NodePrim> insu;
-        std::vector<NodePrim> obst;
-        std::vector<NodePrim> prim;
+        uint32_t prim_n = 0;
+        uint32_t insu_n = 0;
+        uint32_t obst_n = 0;
+        const NodePrim *first_insu = nullptr;
+        const NodePrim *first_obst = nullptr;
 
         // need to loop primitives, so we can duplicate node if there is insulation/obstruction primitives
 
@@ -213,109 +284,141 @@ void RvmParser::store_last_node()
         {
             if (tri.type == Geometry::Type::Primitive)
             {
-                prim.push_back(tri);
+                prim_n += 1;
             }
 
             if (tri.type == Geometry::Type::Insulation)
             {
-                insu.push_back(tri);
+                first_insu = insu_n == 0 ? &tri : first_insu;
+                insu_n += 1;
             }
 
             if (tri.type == Geometry::Type::Obstruction)
             {
-                obst.push_back(tri);
+                first_obst = obst_n == 0 ? &tri : first_obst;
+                obst_n += 1;
             }
         }
 
         if (p_node.primitives.size() == 0)
         {
-
-            MetaNode node;
-            node.id = p_node_count_id;
-            node.parent_id = p_node.parent_id;
-            node.name = p_node.name;
-            node.start = p_node.start;
-            node.count = p_node.count;
-            node.opacity = p_node.opacity;
-            node.color_with_alpha = 0;
-            node.material_id = 0;
-            p_nodes.insert_or_assign(p_node_count_id, std::move(node));
+            p_nodes.add(p_node_count_id, p_node.parent_id, p_node, NameSuffix::none, 0, 0);
         }
 
-        if (prim.size() > 0)
+        if (prim_n > 0)
         {
 
             uint8_t alpha = static_cast<uint8_t>((p_node.opacity * 255) / 100);
             uint32_t color_with_alpha = (alpha << 24) | (p_node.material_id & 0xFFFFFF);
 
-            p_site_color_with_alpha.insert(color_with_alpha);
-
-            MetaNode node;
-            node.id = p_node.id;
-            node.parent_id = p_node.parent_id;
-            node.name = p_node.name;
-            node.start = p_node.start;
-            node.count = p_node.count;
-            node.opacity = p_node.opacity;
-            node.color_with_alpha = color_with_alpha;
-            node.material_id = p_node.material_id;
-            node.primitives = prim;
-            p_nodes.insert_or_assign(p_node_count_id, std::move(node));
+            p_nodes.add(p_node_count_id, p_node.parent_id, p_node, NameSuffix::none, p_node.material_id, color_with_alpha);
+            for (auto &tri : p_node.primitives)
+            {
+                if (tri.type == Geometry::Type::Primitive)
+                {
+                    p_nodes.add_primitive(tri);
+                }
+            }
         }
 
         // TODO: should be option if you want to include this..
-        if (insu.size() > 0)
+        if (insu_n > 0)
         {
-            auto first = insu.front();
-
-            uint8_t alpha = static_cast<uint8_t>((first.opacity * 255) / 100);
+            uint8_t alpha = static_cast<uint8_t>((first_insu->opacity * 255) / 100);
             uint32_t color_with_alpha = (alpha << 24) | (p_node.material_id & 0xFFFFFF);
 
-            p_site_color_with_alpha.insert(color_with_alpha);
-
-            if (prim.size() > 0)
+            if (prim_n > 0)
             {
                 p_node_count_id += 1;
             }
-            MetaNode node;
-            node.id = p_node_count_id;
-            node.parent_id = p_node.parent_id;
-            node.name = p_node.name + std::string("(INSU)"); // TODO: this needs to be a option
-            node.start = p_node.start;
-            node.count = p_node.count;
-            node.opacity = p_node.opacity;
-            node.color_with_alpha = color_with_alpha;
-            node.material_id = p_node.material_id;
-            node.primitives = insu;
-            p_nodes.insert_or_assign(p_node_count_id, std::move(node));
+
+            // TODO: this needs to be a option
+            p_nodes.add(p_node_count_id, p_node.parent_id, p_node, NameSuffix::insulation, p_node.material_id, color_with_alpha);
+            for (auto &tri : p_node.primitives)
+            {
+                if (tri.type == Geometry::Type::Insulation)
+                {
+                    p_nodes.add_primitive(tri);
+                }
+            }
         }
 
         // TODO: should be option if you want to include this..
-        if (obst.size() > 0)
+        if (obst_n > 0)
         {
-
-            auto first = obst.front();
-            uint8_t alpha = static_cast<uint8_t>((first.opacity * 255) / 100);
+            uint8_t alpha = static_cast<uint8_t>((first_obst->opacity * 255) / 100);
             uint32_t color_with_alpha = (alpha << 24) | (p_node.material_id & 0xFFFFFF);
 
-            p_site_color_with_alpha.insert(color_with_alpha);
-
-            if (prim.size() > 0 || insu.size() > 0)
+            if (prim_n > 0 || insu_n > 0)
             {
                 p_node_count_id += 1;
             }
 
-            MetaNode node;
-            node.id = p_node_count_id;
-            node.parent_id = p_node.parent_id;
-            node.name = p_node.name + std::string("(OBST)"); // TODO: this needs to be a option
-            node.start = p_node.start;
-            node.count = p_node.count;
-            node.opacity = p_node.opacity;
-            node.color_with_alpha = color_with_alpha;
-            node.material_id = p_node.material_id;
-            node.primitives = obst;
-            p_nodes.insert_or_assign(p_node_count_id, std::move(node));
+            // TODO: this needs to be a option
+            p_nodes.add(p_node_count_id, p_node.parent_id, p_node, NameSuffix::obstruction, p_node.material_id, color_with_alpha);
+            for (auto &tri : p_node.primitives)
+            {
+                if (tri.type == Geometry::Type::Obstruction)
+                {
+                    p_nodes.add_primitive(tri);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Nodes only have color index from CNTB, we bind them to rgb when root is done
+ * and group nodes with primitives by color, so glb generation only needs to look at nodes of each color
+ */
+void RvmParser::resolve_root_colors(ColorBuckets &buckets)
+{
+    buckets.colors.clear();
+    buckets.start.clear();
+    buckets.rows.clear();
+
+    for (size_t n = 0; n < p_nodes.size(); n++)
+    {
+        if (p_nodes.prim_count[n] == 0)
+        {
+            continue;
+        }
+
+        auto &color = p_nodes.color_with_alpha[n];
+        color = (color & 0xFF000000) | p_color_store.get_color(p_nodes.material_id[n]);
+        buckets.colors.push_back(color);
+    }
+
+    std::sort(buckets.colors.begin(), buckets.colors.end());
+    buckets.colors.erase(std::unique(buckets.colors.begin(), buckets.colors.end()), buckets.colors.end());
+
+    // counting sort, rows keep file order within each color
+    std::vector<uint32_t> bucket_of_row(p_nodes.size());
+    buckets.start.assign(buckets.colors.size() + 1, 0);
+    for (size_t n = 0; n < p_nodes.size(); n++)
+    {
+        if (p_nodes.prim_count[n] == 0)
+        {
+            continue;
+        }
+
+        auto it = std::lower_bound(buckets.colors.begin(), buckets.colors.end(), p_nodes.color_with_alpha[n]);
+        bucket_of_row[n] = static_cast<uint32_t>(it - buckets.colors.begin());
+        buckets.start[bucket_of_row[n] + 1] += 1;
+    }
+
+    for (size_t i = 1; i < buckets.start.size(); i++)
+    {
+        buckets.start[i] += buckets.start[i - 1];
+    }
+
+    buckets.rows.resize(buckets.start.back());
+    std::vector<uint32_t> next(buckets.start.begin(), buckets.start.end() - 1);
+    for (size_t n = 0; n < p_nodes.size(); n++)
+    {
+        if (p_nodes.prim_count[n] > 0)
+        {
+            buckets.rows[next[bucket_of_row[n]]++] = static_cast<uint32_t>(n);
         }
     }
 }
@@ -341,11 +444,11 @@ int RvmParser::start_reading()
 
     HeadBlock headerBlock = parse_head_block();
 
-    if (p_index != p_next_chunk)
+    if (p_index_total != p_next_chunk)
     {
         p_collected_errors.push_back("Uexpected chunk found on HEAD");
         std::cout << "Uexpected chunk found on HEAD" << std::endl;
-        std::cout << "Expected:" << p_next_chunk << " at:" << static_cast<uint32_t>(p_index_total) << std::endl;
+        std::cout << "Expected:" << p_next_chunk << " at:" << p_index_total << std::endl;
         return 2;
     }
 
@@ -366,21 +469,40 @@ int RvmParser::start_reading()
 
     ModlBlock modlBlock = parse_modl_block();
 
-    if (p_index != p_next_chunk)
+    if (p_index_total != p_next_chunk)
     {
         p_collected_errors.push_back("Uexpected chunk found on MODL");
         std::cout << "Uexpected chunk found on MODL" << std::endl;
-        std::cout << "Expected:" << p_next_chunk << " at:" << static_cast<uint32_t>(p_index_total) << std::endl;
+        std::cout << "Expected:" << p_next_chunk << " at:" << p_index_total << std::endl;
         return 2;
     }
 
+    if (p_threads > 1 && read_roots_parallel())
+    {
+        return 0;
+    }
+
+    return read_chunks(p_buffer_total_length);
+}
+
+int RvmParser::read_chunks(uint64_t end)
+{
+
+    char chunk_name[5] = {0, 0, 0, 0, 0};
+
     ////////////////////////
     // ALL ELEMENTS
     ////////////////////////
 
-    while (p_index < p_buffer_total_length)
+    while (p_index_total < end)
     {
 
+        // hash last chunk while its still in cache
+        if (p_level > p_export_level)
+        {
+            update_root_hash();
+        }
+
         p_next_chunk = parse_chunk(chunk_name);
 
         // verify offset
@@ -399,22 +521,22 @@ int RvmParser::start_reading()
             // quickfix for cntb version 4 offset i dont know what is..
             if (cntb.version == 4)
             {
-                if (static_cast<uint32_t>(p_index_total) < p_next_chunk)
+                if (p_index_total < p_next_chunk)
                 {
-                    std::cout << "fixing, Expected:" << p_next_chunk << " at:" << static_cast<uint32_t>(p_index_total) << std::endl;
+                    std::cout << "fixing, Expected:" << p_next_chunk << " at:" << p_index_total << std::endl;
                     std::cout << cntb.name << std::endl;
-                    while (p_next_chunk != static_cast<uint32_t>(p_index_total))
+                    while (p_index_total < p_next_chunk && p_index_total < p_buffer_end)
                     {
                         read_uint8();
                     }
                 }
             }
 
-            if (static_cast<uint32_t>(p_index_total) != p_next_chunk)
+            if (p_index_total != p_next_chunk)
             {
                 p_collected_errors.push_back("Uexpected chunk found on CNTB, at root:" + current_root_name);
                 std::cout << "Uexpected chunk found on CNTB" << current_root_name << std::endl;
-                std::cout << "Expected:" << p_next_chunk << " at:" << static_cast<uint32_t>(p_index_total) << std::endl;
+                std::cout << "Expected:" << p_next_chunk << " at:" << p_index_total << std::endl;
                 return 2;
             }
 
@@ -424,24 +546,58 @@ int RvmParser::start_reading()
                 break;
             }
 
+            // cntb name points into chunk, roots needs their own copy
+            std::string root_name;
+            if (p_level == p_export_level)
+            {
+                root_name = cntb.name;
+            }
+
+            if (p_level == p_export_level && !is_root_included(root_name))
+            {
+                if (!skip_subtree())
+                {
+                    p_collected_errors.push_back("Unable to skip root: " + root_name);
+                    std::cout << "Unable to skip root: " << root_name << std::endl;
+                    return 2;
+                }
+
+                std::cout << "Skipping root: " << root_name << std::endl;
+                break;
+            }
+
+            if (p_level == p_export_level)
+            {
+                p_root_colors = colors_fingerprint();
+            }
+
+            if (p_level == p_export_level && reuse_previous_root(root_name))
+            {
+                break;
+            }
+
             if (p_level == p_export_level)
             {
 
-                MD5 new_ctx;
-                // overwrite old context when we start new group
-                p_md5 = new_ctx;
+                // start new hash when we start new group
+                p_root_hash.reset();
+                p_root_hash_offset = p_index_total;
 
                 if (arenaTriangulation == nullptr)
                 {
                     arenaTriangulation = new Arena();
+                    configure_arena(*arenaTriangulation);
                 }
                 else
                 {
                     p_nodes.clear();
                     arenaTriangulation->clear();
+                    p_root_geometry_arena.clear();
+                    // nothing from last root points into cache anymore
+                    p_tessellator.trim_cache();
                 }
 
-                current_root_name = cntb.name;
+                current_root_name = root_name;
 
                 // we reset IDs per root lvl, since we do export per root lvl
                 p_node_count_id = 0;
@@ -459,7 +615,8 @@ int RvmParser::start_reading()
             // reset our shared node
             p_node.id = p_node_count_id;
             p_node.parent_id = p_parent_stack.back();
-            p_node.name = cntb.name;
+            p_node.name_offset = p_nodes.add_name(cntb.name);
+            p_node.name_length = static_cast<uint32_t>(cntb.name.length());
             p_node.start = 0;
             p_node.count = 0;
             p_node.version = cntb.version;
@@ -481,16 +638,19 @@ int RvmParser::start_reading()
         {
             ColrBlock colrBlock = parse_colr_block();
 
-            if (static_cast<uint32_t>(p_index_total) != p_next_chunk)
+            // used by roots we have not generated yet
+            p_color_store.p_id_hex[colrBlock.index] = (uint32_t(colrBlock.color[0]) << 16) | (uint32_t(colrBlock.color[1]) << 8) | uint32_t(colrBlock.color[2]);
+
+            if (p_index_total != p_next_chunk)
             {
                 p_collected_errors.push_back("Uexpected chunk found on COLR");
                 // in theory this could be the last element, so we could allow it...
                 std::cout << "Uexpected chunk found on COLR" << current_root_name << std::endl;
-                std::cout << "Expected:" << p_next_chunk << " at:" << static_cast<uint32_t>(p_index_total) << std::endl;
+                std::cout << "Expected:" << p_next_chunk << " at:" << p_index_total << std::endl;
                 return 2;
             }
 
-            std::cout << "ColorBlock found, skipping" << std::endl;
+            std::cout << "ColorBlock found, index: " << colrBlock.index << std::endl;
         }
         break;
         ////////////////////////
@@ -500,11 +660,11 @@ int RvmParser::start_reading()
         {
 
             read_uint32_be();
-            if (static_cast<uint32_t>(p_index_total) != p_next_chunk)
+            if (p_index_total != p_next_chunk)
             {
                 p_collected_errors.push_back("Uexpected chunk found on END:");
                 std::cout << "Uexpected chunk found on END:" << current_root_name << std::endl;
-                std::cout << "Expected:" << p_next_chunk << " at:" << static_cast<uint32_t>(p_index_total) << std::endl;
+                std::cout << "Expected:" << p_next_chunk << " at:" << p_index_total << std::endl;
                 return 2;
             }
 
@@ -520,11 +680,11 @@ int RvmParser::start_reading()
             // skip version
             read_uint32_be();
 
-            if (static_cast<uint32_t>(p_index_total) != p_next_chunk)
+            if (p_index_total != p_next_chunk)
             {
                 p_collected_errors.push_back("Uexpected chunk found on CNTE");
                 std::cout << "Uexpected chunk found on CNTE" << current_root_name << std::endl;
-                std::cout << "Expected:" << p_next_chunk << " at:" << static_cast<uint32_t>(p_index_total) << std::endl;
+                std::cout << "Expected:" << p_next_chunk << " at:" << p_index_total << std::endl;
                 return 2;
             }
 
@@ -543,16 +703,14 @@ int RvmParser::start_reading()
             {
 
                 store_last_node();
-                p_md5.finalize();
-                std::vector<uint32_t> colors;
-                for (uint32_t color_id : p_site_color_with_alpha)
-                {
-                    colors.push_back(color_id);
-                }
+                update_root_hash();
+                tessellate_root_geometries();
+                ColorBuckets buckets;
+                resolve_root_colors(buckets);
 
-                std::string root_md5 = p_md5.hexdigest();
+                std::string root_md5 = p_root_hash.hexdigest();
 
-                std::cout << "Generating root: " << current_root_name << ", MD5:" << root_md5 << '\n';
+                std::cout << "Generating root: " << current_root_name << ", hash:" << root_md5 << '\n';
 
                
                 
@@ -560,11 +718,12 @@ int RvmParser::start_reading()
 
             
 
-                auto file_name = generate_glb_from_current_root(colors, tempBox);
+                auto file_name = generate_glb_from_current_root(buckets, tempBox);
 
                 if(p_is_dry_run == true){
                     FileMeta file_meta;
                     file_meta.md5 = root_md5;
+                    file_meta.colors = p_root_colors;
                     file_meta.root_name = current_root_name;
                     file_meta.file_name = "NA - dry run";
                     file_meta.bbox = std::move(tempBox);
@@ -577,6 +736,7 @@ int RvmParser::start_reading()
                     // store current root level for later, so we can make a json file with this info
                     FileMeta file_meta;
                     file_meta.md5 = root_md5;
+                    file_meta.colors = p_root_colors;
                     file_meta.root_name = current_root_name;
                     file_meta.file_name = file_name;
                     file_meta.bbox = std::move(tempBox);
@@ -585,14 +745,14 @@ int RvmParser::start_reading()
                     {
                         // just incase, should we have a error array ?
                         p_collected_errors.push_back("Root name aready exsist: " + current_root_name);
-                        std::cout << "Root name aready exsist: " << current_root_name << ", MD5:" << root_md5 << '\n';
+                        std::cout << "Root name aready exsist: " << current_root_name << ", hash:" << root_md5 << '\n';
                     }
 
                     p_filemeta_map.insert_or_assign(current_root_name, file_meta);
                 }
                 else
                 {
-                    std::cout << "Root name had no triangles, skipping: " << current_root_name << ", MD5:" << root_md5 << '\n';
+                    std::cout << "Root name had no triangles, skipping: " << current_root_name << ", hash:" << root_md5 << '\n';
                 }
             }
 
@@ -613,10 +773,10 @@ int RvmParser::start_reading()
             // quickfix for cntb version 4 offset i dont know what is..
             if (p_node.version == 4)
             {
-                if (static_cast<uint32_t>(p_index_total) < p_next_chunk)
+                if (p_index_total < p_next_chunk)
                 {
-                    std::cout << "fixing, Expected:" << p_next_chunk << " at:" << static_cast<uint32_t>(p_index_total) << std::endl;
-                    while (p_next_chunk != static_cast<uint32_t>(p_index_total))
+                    std::cout << "fixing, Expected:" << p_next_chunk << " at:" << p_index_total << std::endl;
+                    while (p_index_total < p_next_chunk && p_index_total < p_buffer_end)
                     {
                         read_uint8();
                     }
@@ -624,11 +784,11 @@ int RvmParser::start_reading()
             }
 
             // if we cant fix its a error..
-            if (static_cast<uint32_t>(p_index_total) != p_next_chunk)
+            if (p_index_total != p_next_chunk)
             {
                 p_collected_errors.push_back("Uexpected chunk found on PRIM/OBST/INSU: " + current_root_name);
                 std::cout << "Uexpected chunk found on PRIM/OBST/INSU:" << current_root_name << std::endl;
-                std::cout << "Expected:" << p_next_chunk << " at:" << static_cast<uint32_t>(p_index_total) << std::endl;
+                std::cout << "Expected:" << p_next_chunk << " at:" << p_index_total << std::endl;
                 return 2;
             }
 
@@ -2,29 +2,35 @@
 #include <cstdint>
 #include <unordered_map>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <fstream>
 #include <set>
+#include <cassert>
 #include "Arena.h"
+#include "MappedFile.h"
+#include "StreamReader.h"
 #include "Geometry.h"
+#include "Tessellator.h"
 #include "ColorStore.h"
-#include "md5.h"
+#include "Hasher.h"
+#include "GlbWriter.h"
 #include <cfloat> // for FLT_MAX, -FLT_MAX
 
-void rotate_z_up_to_y_up(float &x, float &y, float &z);
-
 struct NodePrim
 {
     uint8_t opacity;
     Geometry::Type type;
     Triangulation *triangulation;
+    // with hidden cap removal, primitive waits here until whole root is read, see tessellate_root_geometries
+    Geometry *geometry = nullptr;
 };
 
 struct MetaNode
 {
     uint32_t id;
     uint32_t parent_id;
-    std::string name;
+    uint32_t name_offset; // in NodeTable::name_pool
+    uint32_t name_length;
     uint32_t material_id;
     uint32_t start;
     uint32_t count;
@@ -34,6 +40,127 @@ struct MetaNode
     std::vector<NodePrim> primitives;
 };
 
+// insulation/obstruction nodes share name with their node, suffix is added when written
+enum struct NameSuffix : uint8_t
+{
+    none = 0,
+    insulation = 1,
+    obstruction = 2,
+};
+
+/**
+ * Nodes of current root, stored as columns so loops over them are linear
+ * Ids are given in order while reading, so row is always id - 1
+ * Primitives of all nodes are in one array, each node has a range in it
+ * Names are stored once in name_pool, nodes only have offset and length
+ */
+struct NodeTable
+{
+    std::vector<uint32_t> parent_id;
+    std::vector<uint32_t> name_offset;
+    std::vector<uint32_t> name_length;
+    std::vector<NameSuffix> name_suffix;
+    std::vector<uint32_t> material_id;
+    std::vector<uint32_t> color_with_alpha;
+    std::vector<uint32_t> start;
+    std::vector<uint32_t> count;
+    std::vector<uint8_t> opacity;
+    std::vector<uint32_t> prim_start;
+    std::vector<uint32_t> prim_count;
+    std::vector<uint8_t> removed;
+
+    std::vector<NodePrim> primitives;
+
+    // names of all nodes after each other, offsets stays valid when it grows
+    std::string name_pool;
+
+    size_t size() const { return parent_id.size(); }
+
+    static uint32_t id(size_t row) { return static_cast<uint32_t>(row + 1); }
+
+    uint32_t add_name(std::string_view node_name)
+    {
+        auto offset = static_cast<uint32_t>(name_pool.size());
+        name_pool.append(node_name);
+        return offset;
+    }
+
+    std::string_view base_name(size_t row) const
+    {
+        return std::string_view(name_pool).substr(name_offset[row], name_length[row]);
+    }
+
+    std::string name(size_t row) const
+    {
+        std::string full_name(base_name(row));
+        switch (name_suffix[row])
+        {
+        case NameSuffix::insulation:
+            full_name += "(INSU)";
+            break;
+        case NameSuffix::obstruction:
+            full_name += "(OBST)";
+            break;
+        case NameSuffix::none:
+            break;
+        }
+        return full_name;
+    }
+
+    void add(uint32_t id, uint32_t parent, const MetaNode &node, NameSuffix suffix, uint32_t material, uint32_t color)
+    {
+        // id is only checked, row is always next one
+        (void)id;
+        assert(id == size() + 1);
+        parent_id.push_back(parent);
+        name_offset.push_back(node.name_offset);
+        name_length.push_back(node.name_length);
+        name_suffix.push_back(suffix);
+        material_id.push_back(material);
+        color_with_alpha.push_back(color);
+        start.push_back(0);
+        count.push_back(0);
+        opacity.push_back(node.opacity);
+        prim_start.push_back(static_cast<uint32_t>(primitives.size()));
+        prim_count.push_back(0);
+        removed.push_back(0);
+    }
+
+    // adds to last node
+    void add_primitive(const NodePrim &prim)
+    {
+        primitives.push_back(prim);
+        prim_count.back() += 1;
+    }
+
+    void clear()
+    {
+        parent_id.clear();
+        name_offset.clear();
+        name_length.clear();
+        name_suffix.clear();
+        material_id.clear();
+        color_with_alpha.clear();
+        start.clear();
+        count.clear();
+        opacity.clear();
+        prim_start.clear();
+        prim_count.clear();
+        removed.clear();
+        primitives.clear();
+        name_pool.clear();
+    }
+};
+
+// rows of node table grouped by color, made once per root
+// rows of colors[i] is rows[start[i]] until rows[start[i + 1]]
+struct ColorBuckets
+{
+    std::vector<uint32_t> colors;
+    std::vector<uint32_t> start;
+    std::vector<uint32_t> rows;
+};
+
 struct NodeBox3
 {
     float X;
@@ -85,6 +212,8 @@ struct FileMeta
     std::string root_name;
     std::string file_name;
     std::string md5;
+    // hash of color table when root started, glb is only reused if colors are the same
+    std::string colors;
     bbox3 bbox;
 
     // might want some more here later
@@ -93,12 +222,29 @@ struct FileMeta
     // bsphere ?
 };
 
+// CNTB/CNTE pair found by the root index pre pass
+struct RootIndexEntry
+{
+    std::string name;
+    uint64_t begin; // offset of CNTB chunk
+    uint64_t end;   // offset after matching CNTE chunk
+    uint32_t depth; // 0 = site
+};
+
+// COLR chunk found by the root index pre pass
+struct ColrIndexEntry
+{
+    uint64_t offset; // offset of COLR chunk
+    uint32_t index;
+    uint32_t color; // 0xRRGGBB
+};
+
 struct CntbBlock
 {
     uint32_t version;
-    std::string name;
+    std::string_view name; // points into chunk, only valid until next chunk is read
     float translation[3];
-    uint32_t material;
+    uint32_t material; // color index, resolved to rgb when root is done
     float opacity;
 };
 
@@ -115,11 +261,32 @@ constexpr uint32_t chunk_id(const char *str)
     return str[3] << 24 | str[2] << 16 | str[1] << 8 | str[0];
 }
 
+inline uint32_t peek_uint32_be(const uint8_t *b)
+{
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+}
+
+// offset in file is only 32 bit, so files over 4GB wraps around
+// next chunk is always after this one, so we can recover the upper bits from where chunk starts
+inline uint64_t unwrap_chunk_offset(uint64_t chunk_start, uint32_t next_chunk)
+{
+    uint64_t next_chunk_offset = (chunk_start & ~uint64_t(0xFFFFFFFF)) | next_chunk;
+    if (next_chunk_offset <= chunk_start)
+    {
+        next_chunk_offset += uint64_t(1) << 32;
+    }
+    return next_chunk_offset;
+}
+
 class RvmParser
 {
 
 public:
     RvmParser() = default;
+    RvmParser(const RvmParser &) = delete;
+    RvmParser &operator=(const RvmParser &) = delete;
+    ~RvmParser();
+
     int read_file(
         std::string filename,
         std::string output_path,
@@ -130,15 +297,35 @@ public:
         float tolerance,
         float meshopt_threshold,
         float meshopt_target_error,
-        bool is_dry_run);
+        bool is_dry_run,
+        HashType hash_type,
+        bool use_root_index,
+        unsigned threads,
+        std::vector<std::string> include_roots,
+        std::vector<std::string> exclude_roots,
+        std::string incremental_status_file,
+        bool use_stream,
+        size_t arena_page_size,
+        size_t arena_keep_size,
+        bool arena_huge_pages,
+        size_t tessellation_cache_size,
+        uint32_t instancing_min_count,
+        bool remove_hidden_caps,
+        Compression compression,
+        bool quantize_positions);
 
 private:
-    std::ifstream file_stream_color_search;
-    std::ifstream file_stream;
-    uint32_t p_index_total = 0;
-    uint32_t p_next_chunk = 0;
-
-    MD5 p_md5;
+    MappedFile p_file;
+    StreamReader p_stream;
+    bool p_is_streaming = false;
+    uint64_t p_index_total = 0;
+    uint64_t p_next_chunk = 0;
+
+    // hash of current root, fed with everything consumed since p_root_hash_offset
+    Hasher p_root_hash;
+    uint64_t p_root_hash_offset = 0;
+    // colors_fingerprint() when current root started
+    std::string p_root_colors;
 
     // 0 = site/first CNTB lvl
     // 1 = zone
@@ -152,19 +339,52 @@ private:
     float p_meshopt_threshold = 0.f;
     float p_meshopt_target_error = 0.f;
     bool p_is_dry_run = false;
+    // primitives repeated at least this many times within a color are written as EXT_mesh_gpu_instancing, 0 = off
+    uint32_t p_instancing_min_count = 0;
+    // connect primitives of a root before tessellating, so caps inside neighbours can be skipped
+    bool p_remove_hidden_caps = false;
+    // how buffer views in glb files are compressed
+    Compression p_compression = Compression::none;
+    // positions relative to node origin, as int16 when precise enough
+    bool p_quantize_positions = false;
+    bool p_use_root_index = false;
+    unsigned p_threads = 1;
+
+    // name patterns for roots at export level, supports * and ?
+    std::vector<std::string> p_include_roots;
+    std::vector<std::string> p_exclude_roots;
+
+    // models from status file of last run, key is root name
+    // roots with same hash and existing glb file is reused
+    std::unordered_map<std::string, FileMeta> p_previous_filemeta;
 
     // vars for loopin buffer
-    uint32_t p_index = 0;
     uint32_t p_level = 0;
     std::string current_root_name;
 
-    uint16_t p_buffer_size = 1024;
-    uint8_t *p_buffer;
-    uint32_t p_buffer_input_length;
-    uint32_t p_buffer_total_length;
+    // bytes we can read, p_buffer[0] is at file offset p_buffer_offset
+    // mapped file is one window over whole file, when streaming its the current chunk
+    const uint8_t *p_buffer = nullptr;
+    uint64_t p_buffer_offset = 0;
+    uint64_t p_buffer_end = 0;
+    // unknown when streaming, END: chunk stops us
+    uint64_t p_buffer_total_length = 0;
 
     Arena *arenaTriangulation = nullptr;
 
+    // page settings for our arenas, see Arena
+    size_t p_arena_page_size = 1024 * 1024 * 50;
+    size_t p_arena_keep_size = 0;
+    bool p_arena_huge_pages = false;
+
+    // reused for every PRIM/OBST/INSU chunk, so we dont malloc per primitive
+    Arena p_prim_arena;
+    Geometry p_prim_geometry;
+    Tessellator p_tessellator;
+
+    // geometries of current root waiting for tessellation, only used with p_remove_hidden_caps
+    Arena p_root_geometry_arena;
+
     HeadBlock p_header;
     std::unordered_map<std::string, FileMeta> p_filemeta_map;
     std::vector<std::string> p_collected_errors;
@@ -178,21 +398,35 @@ private:
 
     ColorStore p_color_store;
 
-    // key here is the p_node_count_id
-    std::unordered_map<uint32_t, MetaNode> p_nodes;
-    std::set<uint32_t> p_site_color_with_alpha;
+    // CNTB/CNTE ranges down to export level, from .rvmidx file or pre pass
+    std::vector<RootIndexEntry> p_root_index;
+    // COLR chunks in file order, so workers knows colors that 1 thread would have seen before a root
+    std::vector<ColrIndexEntry> p_colr_index;
+
+    // row here is p_node_count_id - 1
+    NodeTable p_nodes;
+
+    const uint8_t *buffer_at(uint64_t offset) const { return p_buffer + (offset - p_buffer_offset); }
+
+    bool load_window(uint64_t offset, uint64_t length);
 
     uint8_t read_uint8();
 
+    void update_root_hash();
+
     uint32_t read_uint32_be();
 
     void store_last_node();
 
+    void resolve_root_colors(ColorBuckets &buckets);
+
     float read_float32_be();
 
+    std::string_view read_string_view();
+
     std::string read_string();
 
-    uint32_t parse_chunk(char *chunk_name);
+    uint64_t parse_chunk(char *chunk_name);
 
     HeadBlock parse_head_block();
 
@@ -200,17 +434,40 @@ private:
 
     ColrBlock parse_colr_block();
 
+    void read_trailing_colors();
+
+    void read_trailing_colors_from_file(const std::string &filename);
+
     CntbBlock parse_cntb_block();
 
     void parse_prim_block(uint32_t chunk_name_id);
 
+    void tessellate_root_geometries();
+
+    void configure_arena(Arena &arena) const;
+
     int start_reading();
 
-    uint32_t get_file_size(std::string filename);
+    int read_chunks(uint64_t end);
+
+    void init_worker(const RvmParser &main);
+    int read_root(const RootIndexEntry &root, const RvmParser &main);
+    bool read_roots_parallel();
+
+    void init_root_index(const std::string &rvm_filename);
+    bool build_root_index();
+    bool find_subtree_end(uint64_t &end);
+    bool skip_subtree();
+    bool is_root_included(const std::string &name) const;
+    bool read_root_index(const std::string &filename, uint64_t file_time);
+    void write_root_index(const std::string &filename, uint64_t file_time);
 
-    uint32_t read_next_chunk();
+    bool read_previous_status_file(const std::string &filename);
+    bool reuse_previous_root(const std::string &root_name);
+    std::string options_fingerprint() const;
+    std::string colors_fingerprint() const;
 
     std::string get_file_name();
-    std::string generate_glb_from_current_root(std::vector<uint32_t> &colors, bbox3 &bbox);
+    std::string generate_glb_from_current_root(const ColorBuckets &buckets, bbox3 &bbox);
     void generate_status_file();
 };
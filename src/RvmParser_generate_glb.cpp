@@ -1,14 +1,16 @@
 #include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <array>
 #include <string>
 #include <fstream>
 #include "RvmParser.h"
+#include "PositionWelder.h"
+#include "LinAlgOps.h"
 #include <iostream>
+#include <filesystem>
 #include "meshoptimizer-0.21/src/meshoptimizer.h"
-
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION       // todo,  move, prob should not be loaded more than 1 time ?
-#define STB_IMAGE_WRITE_IMPLEMENTATION // todo, move, prob should not be loaded more than 1 time ?// todo, move, prob should not be loaded more than 1 time ?
-#include "tinygltf/tiny_gltf.h"
+#include "GlbWriter.h"
 
 void update_bbox(bbox3 &b, float min_x, float min_y, float min_z, float max_x, float max_y, float max_z)
 {
@@ -29,40 +31,124 @@ void update_bbox(bbox3 &b, float min_x, float min_y, float min_z, float max_x, f
         b.max_z = max_z;
 }
 
-void rotate_z_up_to_y_up(float &x, float &y, float &z)
+/**
+ * Splits shape to world transform into glTF translation, rotation (quaternion xyzw) and scale
+ * Z up to Y up rotation is included, since instanced shapes are written in their own local space
+ * Returns false if transform has shear, since TRS cant express it
+ */
+bool instance_trs(const Mat3x4f &M, float *translation, float *rotation, float *scale)
 {
-    float new_y = z;
-    float new_z = -y;
-    y = new_y;
-    z = new_z;
-}
+    double u[3][3];
+    double s[3];
+    for (int c = 0; c < 3; c++)
+    {
+        // same as zUpToYUp
+        u[c][0] = M.cols[c].x;
+        u[c][1] = M.cols[c].z;
+        u[c][2] = -M.cols[c].y;
 
-// helper if we clean up duplicate positions
-std::string generate_position_id(float x1, float x2, float x3, int precision = 3)
-{
-    // Scale factor based on desired precision
-    int scale_factor = static_cast<int>(std::pow(10, precision));
+        s[c] = std::sqrt(u[c][0] * u[c][0] + u[c][1] * u[c][1] + u[c][2] * u[c][2]);
+        if (!std::isfinite(s[c]) || s[c] == 0.0)
+        {
+            return false;
+        }
+        for (int r = 0; r < 3; r++)
+        {
+            u[c][r] /= s[c];
+        }
+    }
+
+    for (int a = 0; a < 3; a++)
+    {
+        auto &p = u[a];
+        auto &q = u[(a + 1) % 3];
+        if (std::abs(p[0] * q[0] + p[1] * q[1] + p[2] * q[2]) > 1e-4)
+        {
+            return false;
+        }
+    }
+
+    // mirrored, move it into scale so rotation stays proper
+    double det = u[0][0] * (u[1][1] * u[2][2] - u[1][2] * u[2][1]) -
+                 u[1][0] * (u[0][1] * u[2][2] - u[0][2] * u[2][1]) +
+                 u[2][0] * (u[0][1] * u[1][2] - u[0][2] * u[1][1]);
+    if (det < 0.0)
+    {
+        s[0] = -s[0];
+        for (int r = 0; r < 3; r++)
+        {
+            u[0][r] = -u[0][r];
+        }
+    }
 
-    // using precision of 2, will give scale factor of 100
-    // 326.676605 will be 326 68 with scale factor of 100 /precision 2
-    // 326.676605 will be 326 677 with scale factor of 1000 /precision 3
-    // so I prob want to add this as a option to parser, having 3 as default ? its just for viewing..
+    // m(row, col)
+    auto m = [&](int r, int c)
+    { return u[c][r]; };
 
-    // Scale and round the floats to the desired precision
-    int ix1 = static_cast<int>(std::round(x1 * scale_factor));
-    int ix2 = static_cast<int>(std::round(x2 * scale_factor));
-    int ix3 = static_cast<int>(std::round(x3 * scale_factor));
+    double x, y, z, w;
+    double trace = m(0, 0) + m(1, 1) + m(2, 2);
+    if (trace > 0.0)
+    {
+        double k = 0.5 / std::sqrt(trace + 1.0);
+        w = 0.25 / k;
+        x = (m(2, 1) - m(1, 2)) * k;
+        y = (m(0, 2) - m(2, 0)) * k;
+        z = (m(1, 0) - m(0, 1)) * k;
+    }
+    else if (m(0, 0) > m(1, 1) && m(0, 0) > m(2, 2))
+    {
+        double k = 2.0 * std::sqrt(1.0 + m(0, 0) - m(1, 1) - m(2, 2));
+        w = (m(2, 1) - m(1, 2)) / k;
+        x = 0.25 * k;
+        y = (m(0, 1) + m(1, 0)) / k;
+        z = (m(0, 2) + m(2, 0)) / k;
+    }
+    else if (m(1, 1) > m(2, 2))
+    {
+        double k = 2.0 * std::sqrt(1.0 + m(1, 1) - m(0, 0) - m(2, 2));
+        w = (m(0, 2) - m(2, 0)) / k;
+        x = (m(0, 1) + m(1, 0)) / k;
+        y = 0.25 * k;
+        z = (m(1, 2) + m(2, 1)) / k;
+    }
+    else
+    {
+        double k = 2.0 * std::sqrt(1.0 + m(2, 2) - m(0, 0) - m(1, 1));
+        w = (m(1, 0) - m(0, 1)) / k;
+        x = (m(0, 2) + m(2, 0)) / k;
+        y = (m(1, 2) + m(2, 1)) / k;
+        z = 0.25 * k;
+    }
+    double length = std::sqrt(x * x + y * y + z * z + w * w);
 
-    // Preallocate string memory for better performance
-    std::string position_id;
-    position_id.reserve(3 * (precision + 1) + 2); // +2 for the commas
+    rotation[0] = static_cast<float>(x / length);
+    rotation[1] = static_cast<float>(y / length);
+    rotation[2] = static_cast<float>(z / length);
+    rotation[3] = static_cast<float>(w / length);
 
-    // genrerate unique key
-    position_id.append(std::to_string(ix1)).append(",").append(std::to_string(ix2)).append(",").append(std::to_string(ix3));
+    translation[0] = M.m03;
+    translation[1] = M.m23;
+    translation[2] = -M.m13;
+
+    for (int c = 0; c < 3; c++)
+    {
+        scale[c] = static_cast<float>(s[c]);
+    }
 
-    return position_id;
+    return true;
 }
 
+// repeated shape within one color, instances are in node row order
+struct InstanceGroup
+{
+    const Triangulation *shape;
+    std::vector<uint32_t> prims;
+    std::vector<uint32_t> rows;
+    std::vector<float> translations;
+    std::vector<float> rotations;
+    std::vector<float> scales;
+};
+
 std::vector<uint32_t> cleanDegenerateTriangles(
     const uint32_t *indices,
     size_t index_count,
@@ -153,131 +239,350 @@ std::vector<uint32_t> cleanDegenerateTriangles(
     return cleaned;
 }
 
-std::string RvmParser::generate_glb_from_current_root(std::vector<uint32_t> &colors, bbox3 &bbox)
+/**
+ * Reorders mesh so meshopt codecs compresses it well, see EXT_meshopt_compression
+ * Triangles are sorted for vertex cache inside each range ending at range_ends, so draw ranges stays valid
+ * Positions are then sorted in order of first use, unused positions are dropped
+ */
+void optimize_for_compression(std::vector<uint32_t> &indices, std::vector<float> &positions, const std::vector<uint32_t> &range_ends)
 {
+    uint32_t begin = 0;
+    for (auto end : range_ends)
+    {
+        // optimizer needs memory for each vertex, so range is moved down to its lowest index
+        uint32_t first = UINT32_MAX;
+        uint32_t last = 0;
+        for (auto i = begin; i < end; i++)
+        {
+            first = std::min(first, indices[i]);
+            last = std::max(last, indices[i]);
+        }
 
-    tinygltf::TinyGLTF gltf;
-    tinygltf::Model m;
+        if (begin < end)
+        {
+            for (auto i = begin; i < end; i++)
+            {
+                indices[i] -= first;
+            }
+            meshopt_optimizeVertexCache(indices.data() + begin, indices.data() + begin, end - begin, last - first + 1);
+            for (auto i = begin; i < end; i++)
+            {
+                indices[i] += first;
+            }
+        }
+        begin = end;
+    }
 
-    tinygltf::Scene scene;
-    tinygltf::Value::Object meta;
+    auto vertex_count = meshopt_optimizeVertexFetch(positions.data(), indices.data(), indices.size(), positions.data(), positions.size() / 3, 3 * sizeof(float));
+    positions.resize(vertex_count * 3);
+}
+
+/**
+ * Adds positions relative to center of their bounds, node must be placed with origin and scale
+ * Site coordinates are often far from 0, so this keeps float precision for the part that matters
+ * When a int16 step is not larger than max_step, positions are quantized (KHR_mesh_quantization)
+ * Returns accessor index
+ */
+int add_local_positions(GlbWriter &glb, std::vector<float> &&positions, const double *min, const double *max, double max_step, double *origin, double &scale)
+{
+    double half_extent = 0.0;
+    for (int c = 0; c < 3; c++)
+    {
+        // float origin, so float positions below are exact differences
+        origin[c] = static_cast<float>(0.5 * (min[c] + max[c]));
+        half_extent = std::max(half_extent, std::max(max[c] - origin[c], origin[c] - min[c]));
+    }
 
-    tinygltf::Asset asset;
-    asset.version = "2.0";
-    asset.generator = "tinygltf";
+    auto vertex_count = positions.size() / 3;
+    double step = half_extent / 32767.0;
+    if (step > 0.0 && step <= max_step)
+    {
+        // not normalized, so min/max and node scale are plain
+        scale = step;
+        std::vector<int16_t> quantized(4 * vertex_count, 0);
+        double local_min[3] = {32767, 32767, 32767};
+        double local_max[3] = {-32767, -32767, -32767};
+        for (size_t v = 0; v < vertex_count; v++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                auto q = std::lround((positions[3 * v + c] - origin[c]) / step);
+                q = std::min(32767L, std::max(-32767L, q));
+                quantized[4 * v + c] = static_cast<int16_t>(q);
+                local_min[c] = std::min(local_min[c], double(q));
+                local_max[c] = std::max(local_max[c], double(q));
+            }
+        }
+        positions = std::vector<float>();
+        return glb.add_accessor(std::move(quantized), GlbWriter::Short, "VEC3", vertex_count, GlbWriter::ArrayBuffer, local_min, local_max);
+    }
 
-    tinygltf::Value::Object asset_extras;
-    asset_extras["web3dversion"] = tinygltf::Value(2);
-    asset.extras = tinygltf::Value(asset_extras);
+    // bounds are taken from moved positions, so they hold rounded floats exactly
+    scale = 1.0;
+    double local_min[3] = {DBL_MAX, DBL_MAX, DBL_MAX};
+    double local_max[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        positions[i] = static_cast<float>(positions[i] - origin[i % 3]);
+        local_min[i % 3] = std::min(local_min[i % 3], double(positions[i]));
+        local_max[i % 3] = std::max(local_max[i % 3], double(positions[i]));
+    }
+    return glb.add_accessor(std::move(positions), GlbWriter::Float, "VEC3", vertex_count, GlbWriter::ArrayBuffer, local_min, local_max);
+}
 
-    m.asset = asset;
+std::string RvmParser::generate_glb_from_current_root(const ColorBuckets &buckets, bbox3 &bbox)
+{
 
-    tinygltf::Buffer buffer;
+    // merged arrays are handed to glb writer and written straight from there, so we only hold 1 copy
+    GlbWriter glb(p_compression);
 
-    size_t buffer_size = 0;
-    uint32_t node_count = 0;
-    uint32_t accessor_count = 0;
-    uint32_t index_count = 0;
+    // scene extras, Record<"draw_ranges_node" + NODE, Record<ID, [START, COUNT]>> and id_hierarchy
+    auto &meta = glb.extras();
 
     // --------------------------------------------------------
-    // loop colors and generate file with 1 merged mesh per color
+    // next part will remove all elements without primititives
     // --------------------------------------------------------
 
-    for (const auto &color : colors)
+    if (p_remove_elements_without_primitives && buckets.colors.size() > 0)
     {
-
-        // next part will update drawranges for each item
-
-        int32_t start = 0;
-        uint32_t triangle_size = 0;
-        uint32_t verticies_size = 0;
-        for (auto &pair : p_nodes)
+        // children always have higher id than parent, so walking rows backwards is bottom up
+        // a node is kept if it has geometry or a kept child, so whole empty subtrees goes in 1 pass
+        std::vector<uint8_t> has_kept_child(p_nodes.size(), 0);
+        uint32_t cleanup_count = 0;
+        for (size_t n = p_nodes.size(); n-- > 0;)
         {
+            bool has_geometry = false;
+            for (auto p = p_nodes.prim_start[n]; p < p_nodes.prim_start[n] + p_nodes.prim_count[n]; p++)
+            {
+                auto &tri = p_nodes.primitives[p];
+                if (tri.triangulation->triangles_n > 0 || tri.triangulation->vertices_n > 0)
+                {
+                    has_geometry = true;
+                    break;
+                }
+            }
 
-            uint32_t id = pair.first;
-            MetaNode &node = pair.second;
-
-            if (color != node.color_with_alpha || node.primitives.size() == 0)
+            if (!has_geometry && !has_kept_child[n])
             {
+                p_nodes.removed[n] = 1;
+                cleanup_count++;
                 continue;
             }
 
-            node.start = start;
-            for (auto &tri : node.primitives)
+            auto parent_id = p_nodes.parent_id[n];
+            if (parent_id > 0 && parent_id <= n)
             {
-                auto count = tri.triangulation->triangles_n * 3;
-                node.count += count;
-                triangle_size += count;
-                verticies_size += tri.triangulation->vertices_n * 3;
-                start += count;
+                has_kept_child[parent_id - 1] = 1;
             }
         }
 
-        if (triangle_size == 0 && verticies_size == 0)
-        {
-            // if we dont have any primitives, we skip it
-            continue;
-        }
+        std::cout << "Removed empty elements: " << cleanup_count << "\n";
+    }
 
-        // --------------------------------------------------------
-        // next part will remove all elements without primititives
-        // --------------------------------------------------------
+    // --------------------------------------------------------
+    // loop colors and generate file with 1 merged mesh per color
+    // --------------------------------------------------------
+
+    // primitives written as instances, these are left out of merged mesh
+    std::vector<uint8_t> instanced(p_nodes.primitives.size(), 0);
+
+    // writes Record<ID, [START, COUNT]> for one node of draw ranges
+    auto write_range = [&](uint32_t row, size_t start, size_t count)
+    {
+        auto id = std::to_string(NodeTable::id(row));
+        meta.Key(id.c_str(), static_cast<rapidjson::SizeType>(id.length()));
+        meta.StartArray();
+        meta.Int(static_cast<int>(start));
+        meta.Int(static_cast<int>(count));
+        meta.EndArray();
+    };
+
+    for (size_t b = 0; b < buckets.colors.size(); b++)
+    {
+        const uint32_t color = buckets.colors[b];
+        const uint32_t *rows_begin = buckets.rows.data() + buckets.start[b];
+        const uint32_t *rows_end = buckets.rows.data() + buckets.start[b + 1];
+
+        // instanced and merged meshes of same color shares material
+        int material_index = -1;
+        auto get_material = [&]()
+        {
+            if (material_index < 0)
+            {
+                material_index = glb.add_material(color);
+            }
+            return material_index;
+        };
 
         // --------------------------------------------------------
-        // next part will remove all elements without primititives
+        // next part moves repeated primitives into instanced meshes
         // --------------------------------------------------------
 
-        if (p_remove_elements_without_primitives)
+        if (p_instancing_min_count > 0)
         {
+            std::unordered_map<const Triangulation *, uint32_t> group_of_shape;
+            std::vector<InstanceGroup> groups;
+            float translation[3];
+            float rotation[4];
+            float scale[3];
 
-            auto removing_elements_without_primitives = true;
-            auto cleanup_count = 0;
-            while (removing_elements_without_primitives)
+            for (auto *row = rows_begin; row != rows_end; row++)
             {
-                std::set<uint32_t> parents;
-                for (auto &pair : p_nodes)
+                auto n = *row;
+                for (auto p = p_nodes.prim_start[n]; p < p_nodes.prim_start[n] + p_nodes.prim_count[n]; p++)
                 {
-                    MetaNode &node = pair.second;
-                    parents.insert(node.parent_id);
+                    auto *tri = p_nodes.primitives[p].triangulation;
+                    if (tri->shape == nullptr || !instance_trs(*tri->transform, translation, rotation, scale))
+                    {
+                        continue;
+                    }
+
+                    auto search = group_of_shape.emplace(tri->shape, static_cast<uint32_t>(groups.size()));
+                    if (search.second)
+                    {
+                        groups.emplace_back();
+                        groups.back().shape = tri->shape;
+                    }
+
+                    auto &group = groups[search.first->second];
+                    group.prims.push_back(p);
+                    group.rows.push_back(n);
+                    group.translations.insert(group.translations.end(), translation, translation + 3);
+                    group.rotations.insert(group.rotations.end(), rotation, rotation + 4);
+                    group.scales.insert(group.scales.end(), scale, scale + 3);
                 }
+            }
 
-                auto count = 0;
-                std::vector<uint32_t> to_delete;
-                for (auto &pair : p_nodes)
+            for (auto &group : groups)
+            {
+                if (group.prims.size() < p_instancing_min_count)
                 {
+                    continue;
+                }
 
-                    uint32_t id = pair.first;
-                    MetaNode &node = pair.second;
+                auto *shape = group.shape;
+                float shape_min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+                float shape_max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+                for (size_t i = 0; i < 3 * size_t(shape->vertices_n); i++)
+                {
+                    shape_min[i % 3] = std::min(shape_min[i % 3], shape->vertices[i]);
+                    shape_max[i % 3] = std::max(shape_max[i % 3], shape->vertices[i]);
+                }
+
+                // root bbox is in world space, so we take it from the placed copies
+                for (auto p : group.prims)
+                {
+                    auto &tri_bbox = p_nodes.primitives[p].triangulation->bbox;
+                    instanced[p] = 1;
+                    update_bbox(bbox, tri_bbox.min.x, tri_bbox.min.y, tri_bbox.min.z, tri_bbox.max.x, tri_bbox.max.y, tri_bbox.max.z);
+                }
 
-                    auto c = 0;
-                    for (auto &tri : node.primitives)
+                auto instance_count = group.prims.size();
+                double index_min[1] = {0};
+                double index_max[1] = {double(shape->vertices_n - 1)};
+                double position_min[3] = {shape_min[0], shape_min[1], shape_min[2]};
+                double position_max[3] = {shape_max[0], shape_max[1], shape_max[2]};
+
+                // shape lives in tessellation cache until next root, placements goes away with groups
+                int indices_accessor;
+                int positions_accessor;
+                if (p_compression == Compression::meshopt)
+                {
+                    // cached shape is shared, so we reorder a copy
+                    std::vector<uint32_t> shape_indices(shape->indices, shape->indices + 3 * size_t(shape->triangles_n));
+                    std::vector<float> shape_positions(shape->vertices, shape->vertices + 3 * size_t(shape->vertices_n));
+                    optimize_for_compression(shape_indices, shape_positions, {static_cast<uint32_t>(shape_indices.size())});
+
+                    auto index_total = shape_indices.size();
+                    auto vertex_total = shape_positions.size() / 3;
+                    index_max[0] = double(vertex_total) - 1;
+                    indices_accessor = glb.add_accessor(std::move(shape_indices), GlbWriter::UnsignedInt, "SCALAR", index_total, GlbWriter::ElementArrayBuffer, index_min, index_max);
+                    positions_accessor = glb.add_accessor(std::move(shape_positions), GlbWriter::Float, "VEC3", vertex_total, GlbWriter::ArrayBuffer, position_min, position_max);
+                }
+                else
+                {
+                    indices_accessor = glb.add_accessor(shape->indices, shape->triangles_n * 3 * sizeof(uint32_t), GlbWriter::UnsignedInt, "SCALAR", shape->triangles_n * 3, GlbWriter::ElementArrayBuffer, index_min, index_max);
+                    positions_accessor = glb.add_accessor(shape->vertices, shape->vertices_n * 3 * sizeof(float), GlbWriter::Float, "VEC3", shape->vertices_n, GlbWriter::ArrayBuffer, position_min, position_max);
+                }
+                // instance transforms are applied before node transform, so only translation can move to node
+                double origin[3] = {0.0, 0.0, 0.0};
+                if (p_quantize_positions)
+                {
+                    float translation_min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+                    float translation_max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+                    for (size_t i = 0; i < group.translations.size(); i++)
                     {
-                        c += tri.triangulation->triangles_n * 3;
-                        c += tri.triangulation->vertices_n * 3;
+                        translation_min[i % 3] = std::min(translation_min[i % 3], group.translations[i]);
+                        translation_max[i % 3] = std::max(translation_max[i % 3], group.translations[i]);
                     }
-
-                    auto search = parents.find(id);
-                    if (c == 0 && search == parents.end())
+                    for (int c = 0; c < 3; c++)
                     {
-
-                        to_delete.push_back(id);
-                        count++;
-                        cleanup_count++;
+                        origin[c] = static_cast<float>(0.5 * (double(translation_min[c]) + double(translation_max[c])));
+                    }
+                    for (size_t i = 0; i < group.translations.size(); i++)
+                    {
+                        group.translations[i] = static_cast<float>(group.translations[i] - origin[i % 3]);
                     }
                 }
 
-                for (auto id : to_delete)
+                auto translations_accessor = glb.add_accessor(std::move(group.translations), GlbWriter::Float, "VEC3", instance_count, GlbWriter::NoTarget, nullptr, nullptr);
+                auto rotations_accessor = glb.add_accessor(std::move(group.rotations), GlbWriter::Float, "VEC4", instance_count, GlbWriter::NoTarget, nullptr, nullptr);
+                auto scales_accessor = glb.add_accessor(std::move(group.scales), GlbWriter::Float, "VEC3", instance_count, GlbWriter::NoTarget, nullptr, nullptr);
+
+                auto node_index = glb.add_mesh_node(indices_accessor, positions_accessor, get_material(), translations_accessor, rotations_accessor, scales_accessor);
+                if (p_quantize_positions)
+                {
+                    glb.set_node_transform(node_index, origin, 1.0);
+                }
+
+                // draw ranges of instanced node is instances, Record<ID, [FIRST_INSTANCE, INSTANCE_COUNT]>
+                // instances of a node are next to each other, since we added them in row order
+                auto attName = std::string("draw_ranges_node") + std::to_string(node_index);
+                meta.Key(attName.c_str(), static_cast<rapidjson::SizeType>(attName.length()));
+                meta.StartObject();
+                for (size_t i = 0; i < instance_count;)
                 {
-                    p_nodes.erase(id);
+                    auto n = group.rows[i];
+                    size_t first = i;
+                    while (i < instance_count && group.rows[i] == n)
+                    {
+                        i++;
+                    }
+                    write_range(n, first, i - first);
                 }
+                meta.EndObject();
+            }
+        }
+
+        // next part will update drawranges for each item
+
+        int32_t start = 0;
+        uint32_t triangle_size = 0;
+        uint32_t verticies_size = 0;
+        for (auto *row = rows_begin; row != rows_end; row++)
+        {
+            auto n = *row;
 
-                if (count == 0)
+            p_nodes.start[n] = start;
+            for (auto p = p_nodes.prim_start[n]; p < p_nodes.prim_start[n] + p_nodes.prim_count[n]; p++)
+            {
+                if (instanced[p])
                 {
-                    removing_elements_without_primitives = false;
+                    continue;
                 }
+                auto &tri = p_nodes.primitives[p];
+                auto count = tri.triangulation->triangles_n * 3;
+                p_nodes.count[n] += count;
+                triangle_size += count;
+                verticies_size += tri.triangulation->vertices_n * 3;
+                start += count;
             }
+        }
 
-            std::cout << "Removed empty elements: " << cleanup_count << "\n";
+        if (triangle_size == 0 && verticies_size == 0)
+        {
+            // if we dont have any primitives, we skip it
+            continue;
         }
 
         // --------------------------------------------------------
@@ -290,11 +595,10 @@ std::string RvmParser::generate_glb_from_current_root(std::vector<uint32_t> &col
         // collect buffer sizes
         size_t indices_size = triangle_size * sizeof(uint32_t);
         size_t positions_size = verticies_size * sizeof(float);
-        size_t new_buffer_size = buffer_size + indices_size + positions_size;
 
-        // create temp memory space
-        uint32_t *indicies = (uint32_t *)malloc(indices_size);
-        float *positions = (float *)malloc(positions_size);
+        // create temp memory space, without cleanup these are written to file as is
+        std::vector<uint32_t> indicies(indices_size / 4);
+        std::vector<float> positions(positions_size / 4);
 
         uint32_t indecies_count = 0;
         uint32_t c = 0;
@@ -302,28 +606,20 @@ std::string RvmParser::generate_glb_from_current_root(std::vector<uint32_t> &col
         uint32_t max_index = 0;
         uint32_t offset = 0;
 
-        float min_x = 0;
-        float min_y = 0;
-        float min_z = 0;
-
-        float max_x = 0;
-        float max_y = 0;
-        float max_z = 0;
+        // vertices are already placed and rotated to Y up, with bbox, see Tessellator
+        BBox3f mesh_bbox = createEmptyBBox3f();
 
-        bool min_max_first_loop = true;
-
-        for (auto &pair : p_nodes)
+        for (auto *row = rows_begin; row != rows_end; row++)
         {
+            auto n = *row;
 
-            uint32_t id = pair.first;
-            MetaNode &node = pair.second;
-            if (color != node.color_with_alpha || node.primitives.size() == 0)
-            {
-                continue;
-            }
-
-            for (auto &tri : node.primitives)
+            for (auto p = p_nodes.prim_start[n]; p < p_nodes.prim_start[n] + p_nodes.prim_count[n]; p++)
             {
+                if (instanced[p])
+                {
+                    continue;
+                }
+                auto &tri = p_nodes.primitives[p];
                 auto ti = tri.triangulation->triangles_n * 3;
                 for (int i = 0; i < ti; i++)
                 {
@@ -339,71 +635,20 @@ std::string RvmParser::generate_glb_from_current_root(std::vector<uint32_t> &col
                 }
                 offset = max_index + 1;
 
-                for (int i = 0; i < tri.triangulation->vertices_n; i++)
-                {
-                    int u = triangle_count * 3;
-                    int y = i * 3;
-
-                    positions[u] = (float)tri.triangulation->vertices[y];
-                    positions[u + 1] = (float)tri.triangulation->vertices[y + 1];
-                    positions[u + 2] = (float)tri.triangulation->vertices[y + 2];
-
-                    // rvm files are Z up by default, but glb files use Y
-                    // so we want to rotate it
-                    rotate_z_up_to_y_up(positions[u], positions[u + 1], positions[u + 2]);
-
-                    if (min_max_first_loop)
-                    {
-
-                        // first round, set init values and update for each round
-
-                        min_x = positions[u];
-                        min_y = positions[u + 1];
-                        min_z = positions[u + 2];
-
-                        max_x = positions[u];
-                        max_y = positions[u + 1];
-                        max_z = positions[u + 2];
-
-                        min_max_first_loop = false;
-                    }
-
-                    // get bounding box
-                    if (min_x > positions[u])
-                    {
-                        min_x = positions[u];
-                    }
-
-                    if (min_y > positions[u + 1])
-                    {
-                        min_y = positions[u + 1];
-                    }
-
-                    if (min_z > positions[u + 2])
-                    {
-                        min_z = positions[u + 2];
-                    }
-
-                    if (max_x < positions[u])
-                    {
-                        max_x = positions[u];
-                    }
-
-                    if (max_y < positions[u + 1])
-                    {
-                        max_y = positions[u + 1];
-                    }
-
-                    if (max_z < positions[u + 2])
-                    {
-                        max_z = positions[u + 2];
-                    }
-
-                    triangle_count++;
-                }
+                std::memcpy(positions.data() + triangle_count * 3, tri.triangulation->vertices, tri.triangulation->vertices_n * 3 * sizeof(float));
+                triangle_count += tri.triangulation->vertices_n;
+                engulf(mesh_bbox, tri.triangulation->bbox);
             }
         }
 
+        float min_x = mesh_bbox.min.x;
+        float min_y = mesh_bbox.min.y;
+        float min_z = mesh_bbox.min.z;
+
+        float max_x = mesh_bbox.max.x;
+        float max_y = mesh_bbox.max.y;
+        float max_z = mesh_bbox.max.z;
+
         // --------------------------------------------------------
         // next part will clean up position if enabled or use full set
         // --------------------------------------------------------
@@ -414,62 +659,36 @@ std::string RvmParser::generate_glb_from_current_root(std::vector<uint32_t> &col
 
         if (p_remove_duplicate_positions)
         {
+            PositionWelder welder;
+            std::vector<uint32_t> temp_indecies;
+            std::vector<uint32_t> new_index_of;
 
-            for (auto &pair : p_nodes)
+            for (auto *row = rows_begin; row != rows_end; row++)
             {
+                auto n = *row;
 
-                uint32_t id = pair.first;
-                MetaNode &node = pair.second;
+                welder.reset(p_nodes.count[n], p_remove_duplicate_positions_precision);
+                temp_indecies.clear();
 
-                if (color != node.color_with_alpha || node.primitives.size() == 0)
+                for (auto i = p_nodes.start[n]; i < p_nodes.start[n] + p_nodes.count[n]; i++)
                 {
-                    continue;
+                    temp_indecies.push_back(welder.weld(positions.data() + indicies[i] * 3));
                 }
 
-                std::unordered_map<std::string, uint32_t> tmp_position_index_map;
-                std::vector<uint32_t> temp_indecies;
-                std::vector<float> temp_positions;
-                uint32_t temp_index_counter = 0;
-
-                for (auto i = node.start; i < node.start + node.count; i++)
-                {
-                    auto x = indicies[i] * 3;
-
-                    // this just need to be unique
-                    auto x1 = positions[x];
-                    auto x2 = positions[x + 1];
-                    auto x3 = positions[x + 2];
-                    std::string position_id = generate_position_id(x1, x2, x3, p_remove_duplicate_positions_precision);
-
-                    auto search = tmp_position_index_map.find(position_id);
-                    if (search != tmp_position_index_map.end())
-                    {
-                        temp_indecies.push_back(search->second);
-                    }
-                    else
-                    {
-                        temp_indecies.push_back(temp_index_counter);
-                        tmp_position_index_map[position_id] = temp_index_counter;
-                        temp_index_counter++;
-                        temp_positions.push_back(positions[x]);
-                        temp_positions.push_back(positions[x + 1]);
-                        temp_positions.push_back(positions[x + 2]);
-                    }
-                }
+                const std::vector<float> &temp_positions = welder.positions();
 
                 float threshold = p_meshopt_threshold;
                 size_t target_index_count = size_t(temp_indecies.size() * threshold);
                 float target_error = p_meshopt_target_error;
                 float lod_error = 0.f;
                 std::vector<unsigned int> lod(temp_indecies.size());
-                std::unordered_map<std::string, uint32_t> position_index_map;
 
                 lod.resize(
                     meshopt_simplify(
-                        &lod[0],
-                        &temp_indecies[0],
+                        lod.data(),
+                        temp_indecies.data(),
                         temp_indecies.size(),
-                        &temp_positions[0],
+                        temp_positions.data(),
                         temp_positions.size() / 3,
                         12,
                         target_index_count,
@@ -477,213 +696,142 @@ std::string RvmParser::generate_glb_from_current_root(std::vector<uint32_t> &col
                         meshopt_SimplifyLockBorder, //(1) meshopt_SimplifyErrorAbsolute,  (4)
                         &lod_error));
 
-                node.start = static_cast<uint32_t>(new_indecies.size());
+                p_nodes.start[n] = static_cast<uint32_t>(new_indecies.size());
 
-                auto cleanedLod = cleanDegenerateTriangles(&lod[0], lod.size(), &temp_positions[0], temp_positions.size() / 3);
+                auto cleanedLod = cleanDegenerateTriangles(lod.data(), lod.size(), temp_positions.data(), temp_positions.size() / 3);
 
+                // welded positions are already unique, we only need to drop the ones simplify removed
+                new_index_of.assign(welder.size(), UINT32_MAX);
                 for (auto i = 0; i < cleanedLod.size(); i++)
                 {
-                    auto x = cleanedLod[i] * 3;
-                    auto x1 = temp_positions[x];
-                    auto x2 = temp_positions[x + 1];
-                    auto x3 = temp_positions[x + 2];
-                    std::string position_id = generate_position_id(x1, x2, x3, p_remove_duplicate_positions_precision);
-
-                    auto search = position_index_map.find(position_id);
-                    if (search != position_index_map.end())
-                    {
-                        new_indecies.push_back(search->second);
-                    }
-                    else
+                    auto t = cleanedLod[i];
+                    if (new_index_of[t] == UINT32_MAX)
                     {
-                        new_indecies.push_back(index_counter);
-                        position_index_map[position_id] = index_counter;
+                        new_index_of[t] = index_counter;
                         index_counter++;
-                        new_positions.push_back(temp_positions[x]);
-                        new_positions.push_back(temp_positions[x + 1]);
-                        new_positions.push_back(temp_positions[x + 2]);
+                        new_positions.push_back(temp_positions[t * 3]);
+                        new_positions.push_back(temp_positions[t * 3 + 1]);
+                        new_positions.push_back(temp_positions[t * 3 + 2]);
                     }
+                    new_indecies.push_back(new_index_of[t]);
                 }
 
-                node.count = static_cast<uint32_t>(new_indecies.size()) - node.start;
+                p_nodes.count[n] = static_cast<uint32_t>(new_indecies.size()) - p_nodes.start[n];
             }
         }
         else
         {
             // full set
             index_counter = max_index + 1;
-            new_indecies.insert(new_indecies.end(), indicies, indicies + indices_size / 4);
-            new_positions.insert(new_positions.end(), positions, positions + positions_size / 4);
+            new_indecies = std::move(indicies);
+            new_positions = std::move(positions);
         }
 
-        free(indicies);
-        free(positions);
+        if (p_compression == Compression::meshopt)
+        {
+            std::vector<uint32_t> range_ends;
+            for (auto *row = rows_begin; row != rows_end; row++)
+            {
+                auto n = *row;
+                if (p_nodes.count[n] > 0)
+                {
+                    range_ends.push_back(p_nodes.start[n] + p_nodes.count[n]);
+                }
+            }
+            optimize_for_compression(new_indecies, new_positions, range_ends);
+
+            // unused positions are dropped, bbox still holds the rest
+            index_counter = static_cast<uint32_t>(new_positions.size() / 3);
+        }
 
         // --------------------------------------------------------
-        // init tinyglft we need to support indecies and positions
+        // next part hands indecies and positions to glb writer
         // --------------------------------------------------------
 
-        tinygltf::Mesh mesh;
-        tinygltf::Primitive primitive;
-        tinygltf::Node node;
-
-        tinygltf::BufferView bufferView1;
-        tinygltf::BufferView bufferView2;
-        tinygltf::Accessor accessor1;
-        tinygltf::Accessor accessor2;
-        tinygltf::Material mat;
-
-        std::vector<double> base_color;
-        base_color.push_back((1.f / 255.f) * ((color >> 16) & 0xff));
-        base_color.push_back((1.f / 255.f) * ((color >> 8) & 0xff));
-        base_color.push_back((1.f / 255.f) * ((color) & 0xff));
-        base_color.push_back((1.f / 255.f) * ((color >> 24) & 0xff));
-        if (base_color[3] != 1)
-        {
-            mat.alphaMode = "BLEND";
-            base_color[3] = 1.0 - base_color[3];
-        }
-
-        mat.pbrMetallicRoughness.baseColorFactor = base_color;
-        mat.pbrMetallicRoughness.metallicFactor = 0.0;
-        mat.pbrMetallicRoughness.roughnessFactor = 1.0;
-
-        mat.doubleSided = true;
-
-        // indecies
-        bufferView1.buffer = 0;
-        bufferView1.byteOffset = buffer_size;
-        bufferView1.byteLength = new_indecies.size() * sizeof(uint32_t);
-        bufferView1.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
-
-        // positions
-        bufferView2.buffer = 0;
-        bufferView2.byteOffset = buffer_size + new_indecies.size() * sizeof(uint32_t);
-        bufferView2.byteLength = new_positions.size() * sizeof(float);
-        bufferView2.target = TINYGLTF_TARGET_ARRAY_BUFFER;
-
-        // Describe the layout of bufferView1, the indices of the vertices
-        accessor1.bufferView = accessor_count;
-        accessor1.byteOffset = 0;
-        accessor1.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
-        accessor1.count = new_indecies.size();
-        accessor1.type = TINYGLTF_TYPE_SCALAR;
-        accessor1.maxValues.push_back(index_counter - 1);
-        accessor1.minValues.push_back(0);
-        accessor_count += 1;
-
-        // Describe the layout of bufferView2, the vertices themself
-        accessor2.bufferView = accessor_count;
-        accessor2.byteOffset = 0;
-        accessor2.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
-        accessor2.count = new_positions.size() / 3;
-        accessor2.type = TINYGLTF_TYPE_VEC3;
-        accessor2.minValues = {min_x, min_y, min_z};
-        accessor2.maxValues = {max_x, max_y, max_z};
-        accessor_count += 1;
+        double index_min[1] = {0};
+        double index_max[1] = {double(index_counter - 1)};
+        double position_min[3] = {min_x, min_y, min_z};
+        double position_max[3] = {max_x, max_y, max_z};
 
         update_bbox(bbox, min_x, min_y, min_z, max_x, max_y, max_z);
 
-        // Build the mesh primitive and add it to the mesh
-        primitive.indices = index_count;                    // The index of the accessor for the vertex indices
-        primitive.attributes["POSITION"] = index_count + 1; // The index of the accessor for positions
-        primitive.material = m.materials.size();
-        primitive.mode = TINYGLTF_MODE_TRIANGLES;
-        mesh.primitives.push_back(primitive);
-
-        index_count += 2;
-
-        node.mesh = node_count;
-        node.name = std::string("node") + std::to_string(node_count).c_str();
-
-        m.materials.push_back(mat);
-        m.meshes.push_back(mesh);
-        m.nodes.push_back(node);
-        scene.nodes.push_back(node_count);
-
-        m.bufferViews.push_back(bufferView1);
-        m.bufferViews.push_back(bufferView2);
-        m.accessors.push_back(accessor1);
-        m.accessors.push_back(accessor2);
+        auto index_total = new_indecies.size();
+        auto vertex_total = new_positions.size() / 3;
+        auto indices_accessor = glb.add_accessor(std::move(new_indecies), GlbWriter::UnsignedInt, "SCALAR", index_total, GlbWriter::ElementArrayBuffer, index_min, index_max);
+        int positions_accessor;
+        double origin[3];
+        double scale = 1.0;
+        if (p_quantize_positions)
+        {
+            positions_accessor = add_local_positions(glb, std::move(new_positions), position_min, position_max, p_tolerance, origin, scale);
+        }
+        else
+        {
+            positions_accessor = glb.add_accessor(std::move(new_positions), GlbWriter::Float, "VEC3", vertex_total, GlbWriter::ArrayBuffer, position_min, position_max);
+        }
 
-        // extend main raw buffer and clean up
-        buffer_size = buffer_size + (new_indecies.size() * sizeof(uint32_t)) + (new_positions.size() * sizeof(float));
-        buffer.data.insert(buffer.data.end(), reinterpret_cast<char *>(new_indecies.data()), reinterpret_cast<char *>(new_indecies.data()) + (new_indecies.size() * sizeof(uint32_t)));
-        buffer.data.insert(buffer.data.end(), reinterpret_cast<char *>(new_positions.data()), reinterpret_cast<char *>(new_positions.data()) + new_positions.size() * sizeof(float));
+        auto node_index = glb.add_mesh_node(indices_accessor, positions_accessor, get_material());
+        if (p_quantize_positions)
+        {
+            glb.set_node_transform(node_index, origin, scale);
+        }
 
         // --------------------------------------------------------
         // next part collects and add draw_ranges for this node
         // --------------------------------------------------------
 
-        tinygltf::Value::Object record;
-        for (const auto &pair : p_nodes)
+        auto attName = std::string("draw_ranges_node") + std::to_string(node_index);
+        meta.Key(attName.c_str(), static_cast<rapidjson::SizeType>(attName.length()));
+        meta.StartObject();
+        for (auto *row = rows_begin; row != rows_end; row++)
         {
-            uint32_t id = pair.first;
-            const MetaNode &node = pair.second;
-
-            if (color != node.color_with_alpha || node.primitives.size() == 0 || node.count == 0)
+            auto n = *row;
+            if (p_nodes.count[n] == 0)
             {
                 continue;
             }
-
-            tinygltf::Value::Array nodeObject;
-
-            nodeObject.push_back(tinygltf::Value((int)node.start));
-            nodeObject.push_back(tinygltf::Value((int)node.count));
-
-            std::string attName = std::to_string(node.id).c_str();
-
-            record[attName] = tinygltf::Value(nodeObject);
+            write_range(n, p_nodes.start[n], p_nodes.count[n]);
         }
-
-        auto attName = std::string("draw_ranges_node") + std::to_string(node_count).c_str();
-        meta[attName] = tinygltf::Value(record);
-
-        node_count += 1;
+        meta.EndObject();
     }
 
-    m.buffers.push_back(buffer);
-
     // --------------------------------------------------------
     // next part generates the id hierarchy for all ids and adds scene to file
     // --------------------------------------------------------
 
-    tinygltf::Value::Object record;
-    for (const auto &pair : p_nodes)
+    meta.Key("id_hierarchy");
+    meta.StartObject();
+    for (size_t n = 0; n < p_nodes.size(); n++)
     {
-        uint32_t id = pair.first;
-        const MetaNode &node = pair.second;
-
-        tinygltf::Value::Array nodeObject;
-        nodeObject.push_back(tinygltf::Value(node.name));
+        if (p_nodes.removed[n])
+        {
+            continue;
+        }
 
-        std::string parent_id;
-        if (node.parent_id == 0)
+        auto id = std::to_string(NodeTable::id(n));
+        auto name = p_nodes.name(n);
+        meta.Key(id.c_str(), static_cast<rapidjson::SizeType>(id.length()));
+        meta.StartArray();
+        meta.String(name.c_str(), static_cast<rapidjson::SizeType>(name.length()));
+        if (p_nodes.parent_id[n] == 0)
         {
-            parent_id = std::string("*").c_str();
+            meta.String("*");
         }
         else
         {
-            parent_id = std::to_string(node.parent_id).c_str();
+            auto parent_id = std::to_string(p_nodes.parent_id[n]);
+            meta.String(parent_id.c_str(), static_cast<rapidjson::SizeType>(parent_id.length()));
         }
-
-        nodeObject.push_back(tinygltf::Value(parent_id));
-
-        std::string attName = std::to_string(node.id).c_str();
-        record[attName] = tinygltf::Value(nodeObject);
+        meta.EndArray();
     }
-
-    meta["id_hierarchy"] = tinygltf::Value(record);
-    scene.extras = tinygltf::Value(meta);
-
-    m.scenes.push_back(scene);
+    meta.EndObject();
 
     // --------------------------------------------------------
     // next part generate file / directory
     // --------------------------------------------------------
 
     auto name = get_file_name() + ".glb";
-    if (buffer_size > 0)
+    if (glb.buffer_size() > 0)
     {
         if (p_output_path.length() > 0 && !std::filesystem::exists(p_output_path))
         {
@@ -691,11 +839,10 @@ std::string RvmParser::generate_glb_from_current_root(std::vector<uint32_t> &col
             std::cout << "Directory created: " << p_output_path << std::endl;
         }
 
-        gltf.WriteGltfSceneToFile(&m, p_output_path + name.c_str(),
-                                  true,  // embedImages
-                                  true,  // embedBuffers
-                                  true,  // pretty print
-                                  true); // write binary
+        if (!glb.write(p_output_path + name))
+        {
+            return "";
+        }
 
         return name;
     }
@@ -9,7 +9,7 @@
 
 /**
  * Generates status file for current rvm file
- * This will have name of root element, md5 for that root element and file path
+ * This will have name of root element, md5 (or hash_type) for that root element and file path
  * Also have rvm header info
  * Useful if you need to update user files etc
  */
@@ -32,6 +32,7 @@ void RvmParser::generate_status_file()
         Value nodeObject(kObjectType);
         nodeObject.AddMember("root_name", Value().SetString(node.root_name.c_str(), node.root_name.length(), allocator), allocator);
         nodeObject.AddMember("md5", Value().SetString(node.md5.c_str(), node.md5.length(), allocator), allocator);
+        nodeObject.AddMember("colors", Value().SetString(node.colors.c_str(), node.colors.length(), allocator), allocator);
         nodeObject.AddMember("file_name", Value().SetString(node.file_name.c_str(), node.file_name.length(), allocator), allocator);
         nodeObject.AddMember("min_x", Value().SetFloat(node.bbox.min_x), allocator);
         nodeObject.AddMember("min_y", Value().SetFloat(node.bbox.min_y), allocator);
@@ -42,6 +43,9 @@ void RvmParser::generate_status_file()
         models.PushBack(nodeObject, allocator);
     }
     document.AddMember("models", models, allocator);
+    document.AddMember("hash_type", Value().SetString(p_root_hash.get_type_name(), allocator), allocator);
+    auto options = options_fingerprint();
+    document.AddMember("options", Value().SetString(options.c_str(), options.length(), allocator), allocator);
 
     Value warnings(kArrayType);
     for (const auto &warning : p_collected_errors)
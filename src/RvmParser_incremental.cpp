@@ -0,0 +1,203 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include "RvmParser.h"
+#include "rapidjson/include/document.h"
+
+/**
+ * Reads models from status file of last run
+ * Only used if hash type and options that changes glb files are the same as we use now
+ */
+bool RvmParser::read_previous_status_file(const std::string &filename)
+{
+    using namespace rapidjson;
+
+    std::ifstream file_read(filename, std::ios::in | std::ios::binary);
+    if (!file_read.is_open())
+    {
+        return false;
+    }
+    std::string content((std::istreambuf_iterator<char>(file_read)), std::istreambuf_iterator<char>());
+
+    Document document;
+    document.Parse(content.c_str(), content.length());
+    if (document.HasParseError() || !document.IsObject() || !document.HasMember("models") || !document["models"].IsArray())
+    {
+        return false;
+    }
+
+    // older status files only had md5
+    std::string hash_type = "md5";
+    if (document.HasMember("hash_type") && document["hash_type"].IsString())
+    {
+        hash_type = document["hash_type"].GetString();
+    }
+    if (hash_type != p_root_hash.get_type_name())
+    {
+        std::cout << "Status file from last run used hash: " << hash_type << ", we use: " << p_root_hash.get_type_name() << std::endl;
+        return false;
+    }
+
+    // older status files has no options, so we cant know what they were made with
+    std::string options;
+    if (document.HasMember("options") && document["options"].IsString())
+    {
+        options = document["options"].GetString();
+    }
+    if (options != options_fingerprint())
+    {
+        std::cout << "Status file from last run used other options, exporting all roots" << std::endl;
+        return false;
+    }
+
+    auto get_float = [](const Value &object, const char *name, float fallback)
+    {
+        return object.HasMember(name) && object[name].IsNumber() ? object[name].GetFloat() : fallback;
+    };
+
+    p_previous_filemeta.clear();
+    for (const auto &model : document["models"].GetArray())
+    {
+        if (!model.IsObject() ||
+            !model.HasMember("root_name") || !model["root_name"].IsString() ||
+            !model.HasMember("md5") || !model["md5"].IsString() ||
+            !model.HasMember("file_name") || !model["file_name"].IsString())
+        {
+            continue;
+        }
+
+        FileMeta file_meta;
+        file_meta.root_name = model["root_name"].GetString();
+        file_meta.md5 = model["md5"].GetString();
+        file_meta.file_name = model["file_name"].GetString();
+        if (model.HasMember("colors") && model["colors"].IsString())
+        {
+            file_meta.colors = model["colors"].GetString();
+        }
+        file_meta.bbox.min_x = get_float(model, "min_x", file_meta.bbox.min_x);
+        file_meta.bbox.min_y = get_float(model, "min_y", file_meta.bbox.min_y);
+        file_meta.bbox.min_z = get_float(model, "min_z", file_meta.bbox.min_z);
+        file_meta.bbox.max_x = get_float(model, "max_x", file_meta.bbox.max_x);
+        file_meta.bbox.max_y = get_float(model, "max_y", file_meta.bbox.max_y);
+        file_meta.bbox.max_z = get_float(model, "max_z", file_meta.bbox.max_z);
+        p_previous_filemeta.insert_or_assign(file_meta.root_name, std::move(file_meta));
+    }
+
+    std::cout << "Status file from last run read, models: " << p_previous_filemeta.size() << std::endl;
+    return true;
+}
+
+/**
+ * Called when we have read CNTB of a root
+ * Hashes the whole root directly from mapped file, and if it matches last run and glb file still exist
+ * we keep old entry and move past the root without decoding/triangulating it
+ */
+bool RvmParser::reuse_previous_root(const std::string &root_name)
+{
+    auto search = p_previous_filemeta.find(root_name);
+    if (search == p_previous_filemeta.end())
+    {
+        return false;
+    }
+
+    const FileMeta &previous = search->second;
+    if (previous.colors != p_root_colors)
+    {
+        return false;
+    }
+    if (p_is_dry_run == false && !std::filesystem::exists(p_output_path + previous.file_name))
+    {
+        return false;
+    }
+
+    uint64_t end;
+    if (!find_subtree_end(end))
+    {
+        return false;
+    }
+
+    // same span as we hash when reading root, from end of root CNTB to end of CNTE
+    Hasher hash;
+    hash.set_type(p_root_hash.get_type());
+    hash.update(buffer_at(p_index_total), end - p_index_total);
+    std::string root_md5 = hash.hexdigest();
+
+    if (root_md5 != previous.md5)
+    {
+        return false;
+    }
+
+    std::cout << "Root not changed, keeping: " << root_name << ", hash:" << root_md5 << '\n';
+
+    if (auto existing = p_filemeta_map.find(root_name); existing != p_filemeta_map.end())
+    {
+        p_collected_errors.push_back("Root name aready exsist: " + root_name);
+        std::cout << "Root name aready exsist: " << root_name << ", hash:" << root_md5 << '\n';
+    }
+    p_filemeta_map.insert_or_assign(root_name, previous);
+
+    p_index_total = end;
+    p_next_chunk = end;
+    return true;
+}
+
+/**
+ * Everything that changes glb files, apart from the root itself and colors
+ * Threads, arenas, hash and root filters only changes how we get there
+ */
+std::string RvmParser::options_fingerprint() const
+{
+    char options[256];
+    std::snprintf(options, sizeof(options), "l%u e%d d%d p%u t%.9g mt%.9g me%.9g c%d i%u h%d z%u q%d",
+                  unsigned(p_export_level),
+                  int(p_remove_elements_without_primitives),
+                  int(p_remove_duplicate_positions),
+                  unsigned(p_remove_duplicate_positions_precision),
+                  double(p_tolerance),
+                  double(p_meshopt_threshold),
+                  double(p_meshopt_target_error),
+                  int(p_tessellator.use_cache),
+                  unsigned(p_instancing_min_count),
+                  int(p_remove_hidden_caps),
+                  unsigned(p_compression),
+                  int(p_quantize_positions));
+
+    Hasher hash;
+    hash.set_type(p_root_hash.get_type());
+    hash.update(reinterpret_cast<const uint8_t *>(options), std::strlen(options));
+    return hash.hexdigest();
+}
+
+/**
+ * Hash of whole color table in index order, so COLR chunks changed outside a root are noticed
+ * COLR chunks inside a root are part of root hash
+ */
+std::string RvmParser::colors_fingerprint() const
+{
+    std::vector<std::pair<uint32_t, uint32_t>> colors(p_color_store.p_id_hex.begin(), p_color_store.p_id_hex.end());
+    std::sort(colors.begin(), colors.end());
+
+    std::vector<uint8_t> bytes;
+    bytes.reserve(colors.size() * 8);
+    for (auto &color : colors)
+    {
+        for (auto value : {color.first, color.second})
+        {
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                bytes.push_back(uint8_t(value >> shift));
+            }
+        }
+    }
+
+    Hasher hash;
+    hash.set_type(p_root_hash.get_type());
+    hash.update(bytes.data(), bytes.size());
+    return hash.hexdigest();
+}
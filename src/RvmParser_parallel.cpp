@@ -0,0 +1,153 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+#include "RvmParser.h"
+
+/**
+ * Worker only shares settings and the mapped file with main parser
+ * Arena, nodes, colors and hash are owned by the worker
+ */
+void RvmParser::init_worker(const RvmParser &main)
+{
+    p_export_level = main.p_export_level;
+    p_remove_elements_without_primitives = main.p_remove_elements_without_primitives;
+    p_remove_duplicate_positions = main.p_remove_duplicate_positions;
+    p_remove_duplicate_positions_precision = main.p_remove_duplicate_positions_precision;
+    p_output_path = main.p_output_path;
+    p_tolerance = main.p_tolerance;
+    p_meshopt_threshold = main.p_meshopt_threshold;
+    p_meshopt_target_error = main.p_meshopt_target_error;
+    p_is_dry_run = main.p_is_dry_run;
+    p_instancing_min_count = main.p_instancing_min_count;
+    p_remove_hidden_caps = main.p_remove_hidden_caps;
+    p_compression = main.p_compression;
+    p_quantize_positions = main.p_quantize_positions;
+    p_root_hash.set_type(main.p_root_hash.get_type());
+    p_include_roots = main.p_include_roots;
+    p_exclude_roots = main.p_exclude_roots;
+    p_previous_filemeta = main.p_previous_filemeta;
+    p_arena_page_size = main.p_arena_page_size;
+    p_arena_keep_size = main.p_arena_keep_size;
+    p_arena_huge_pages = main.p_arena_huge_pages;
+    configure_arena(p_prim_arena);
+    configure_arena(p_tessellator.cache_arena);
+    configure_arena(p_root_geometry_arena);
+    p_tessellator.use_cache = main.p_tessellator.use_cache;
+    p_tessellator.cache_limit = main.p_tessellator.cache_limit;
+
+    p_buffer = main.p_buffer;
+    p_buffer_offset = main.p_buffer_offset;
+    p_buffer_end = main.p_buffer_end;
+    p_buffer_total_length = main.p_buffer_total_length;
+}
+
+/**
+ * Reads one root (CNTB at export level until matching CNTE) and generates glb for it
+ * Colors are trailing colors from main parser, with COLR chunks before this root applied in file order
+ */
+int RvmParser::read_root(const RootIndexEntry &root, const RvmParser &main)
+{
+    p_color_store = main.p_color_store;
+    for (const auto &colr : main.p_colr_index)
+    {
+        if (colr.offset >= root.begin)
+        {
+            break;
+        }
+        p_color_store.p_id_hex[colr.index] = colr.color;
+    }
+
+    p_index_total = root.begin;
+    p_level = p_export_level;
+
+    return read_chunks(root.end);
+}
+
+/**
+ * Roots at export level are independent, so we let a pool of workers take one root range at a time
+ * Returns false if we cant find the roots, then caller reads file with 1 thread
+ */
+bool RvmParser::read_roots_parallel()
+{
+    if (p_root_index.empty() && !build_root_index())
+    {
+        p_root_index.clear();
+        std::cout << "Unable to build root index, reading with 1 thread" << std::endl;
+        return false;
+    }
+
+    std::vector<const RootIndexEntry *> roots;
+    for (const auto &entry : p_root_index)
+    {
+        if (entry.depth == p_export_level && is_root_included(entry.name))
+        {
+            roots.push_back(&entry);
+        }
+    }
+
+    // biggest roots first, so we dont end up waiting for 1 big root at the end
+    std::sort(roots.begin(), roots.end(), [](const RootIndexEntry *a, const RootIndexEntry *b)
+              { return a->end - a->begin > b->end - b->begin; });
+
+    // create it here, so workers dont race on it
+    if (!p_is_dry_run && p_output_path.length() > 0 && !std::filesystem::exists(p_output_path))
+    {
+        std::filesystem::create_directories(p_output_path);
+        std::cout << "Directory created: " << p_output_path << std::endl;
+    }
+
+    size_t thread_count = std::max<size_t>(1, std::min<size_t>(p_threads, roots.size()));
+    std::cout << "Reading " << roots.size() << " roots using " << thread_count << " threads" << std::endl;
+
+    std::vector<std::unique_ptr<RvmParser>> workers;
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        workers.push_back(std::make_unique<RvmParser>());
+        workers.back()->init_worker(*this);
+    }
+
+    std::atomic<size_t> next_root(0);
+    std::vector<std::thread> threads;
+    for (auto &worker : workers)
+    {
+        RvmParser *w = worker.get();
+        threads.emplace_back([this, w, &roots, &next_root]()
+                             {
+                                 for (size_t i = next_root++; i < roots.size(); i = next_root++)
+                                 {
+                                     // errors are collected by worker, we just move on to next root
+                                     w->read_root(*roots[i], *this);
+                                 } });
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // collect results from workers, so status file looks like we read it with 1 thread
+    for (auto &worker : workers)
+    {
+        for (auto &pair : worker->p_filemeta_map)
+        {
+            if (auto search = p_filemeta_map.find(pair.first); search != p_filemeta_map.end())
+            {
+                p_collected_errors.push_back("Root name aready exsist: " + pair.first);
+                std::cout << "Root name aready exsist: " << pair.first << '\n';
+            }
+            p_filemeta_map.insert_or_assign(pair.first, pair.second);
+        }
+
+        p_collected_errors.insert(p_collected_errors.end(), worker->p_collected_errors.begin(), worker->p_collected_errors.end());
+    }
+
+    p_index_total = p_buffer_total_length;
+
+    return true;
+}
@@ -4,11 +4,10 @@
 #include <vector>
 #include <array>
 #include <set>
-#include <fstream>
 #include <iostream>
 #include <chrono>
-#define _FILE_OFFSET_BITS 64
-#include <sys/stat.h>
+#include <cstring>
+#include <fstream>
 #include "Arena.h"
 #include "RvmParser.h"
 #include "Geometry.h"
@@ -16,106 +15,125 @@
 #include "Tessellator.h"
 #include "TriangulationFactory.h"
 #include "ColorStore.h"
+#include "Connect.h"
 
-uint8_t RvmParser::read_uint8()
+/**
+ * Makes [offset, offset + length) readable through p_buffer
+ * Mapped file has everything already, stream copies it into its window
+ */
+bool RvmParser::load_window(uint64_t offset, uint64_t length)
 {
+    if (!p_is_streaming)
+    {
+        return offset + length <= p_buffer_end;
+    }
 
-    uint32_t index = p_index;
-    p_index += 1;
-    p_index_total += 1;
+    auto *data = p_stream.fetch(offset, length);
+    if (data == nullptr)
+    {
+        // stream ended, nothing more to read
+        p_buffer_offset = offset;
+        p_buffer_end = offset;
+        return false;
+    }
 
+    p_buffer = data;
+    p_buffer_offset = offset;
+    p_buffer_end = offset + length;
+    return true;
+}
 
-    // get byte before we might replace buffer
-    uint8_t b = p_buffer[index];
-    char* c = (char*)&b;
+uint8_t RvmParser::read_uint8()
+{
+    if (p_index_total >= p_buffer_end)
+    {
+        return 0;
+    }
+
+    const uint8_t *b = buffer_at(p_index_total);
+    p_index_total += 1;
 
-    p_md5.update(c, 1);
+    return *b;
+}
 
-    if (p_index == p_buffer_size)
+void RvmParser::update_root_hash()
+{
+    // hash whole span in one go, instead of byte by byte when reading
+    if (p_index_total > p_root_hash_offset)
     {
-        read_next_chunk();
-        p_index = 0;
+        p_root_hash.update(buffer_at(p_root_hash_offset), p_index_total - p_root_hash_offset);
     }
-
-    return b;
+    p_root_hash_offset = p_index_total;
 }
 
 uint32_t RvmParser::read_uint32_be()
 {
-
-    union UintConverter
+    if (p_index_total + 4 > p_buffer_end)
     {
-        uint32_t u32;
-        uint8_t b[sizeof(uint32_t)];
-    } converter;
+        p_index_total = p_buffer_end;
+        return 0;
+    }
 
-    converter.b[3] = read_uint8();
-    converter.b[2] = read_uint8();
-    converter.b[1] = read_uint8();
-    converter.b[0] = read_uint8();
+    // decode directly from mapped file/stream window, rvm is big endian
+    const uint8_t *b = buffer_at(p_index_total);
+    p_index_total += 4;
 
-    return converter.u32;
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
 }
 
 float RvmParser::read_float32_be()
 {
+    uint32_t u = read_uint32_be();
 
-    union FloatConverter
-    {
-        float f;
-        uint8_t b[sizeof(float)];
-    } converter;
-
-    converter.b[3] = read_uint8();
-    converter.b[2] = read_uint8();
-    converter.b[1] = read_uint8();
-    converter.b[0] = read_uint8();
-
-    return converter.f;
+    float f;
+    std::memcpy(&f, &u, sizeof(float));
+    return f;
 }
 
-std::string RvmParser::read_string()
+std::string_view RvmParser::read_string_view()
 {
 
     uint32_t s_len = read_uint32_be();
-    unsigned l = 4 * s_len;
+    uint64_t l = 4 * uint64_t(s_len);
 
     // just incase file is really messed up and give us really big number
-    /* if (p_index + l > p_next_chunk)
+    if (l > p_buffer_end - p_index_total)
     {
-        
-        return "";
-    } */
-
-    std::string temp_string;
-
-    uint32_t x = 0;
-
-    for (unsigned i = 0; i < l; i++)
-    {
-        if (p_buffer[p_index] == 0)
-        {
-            break;
-        }
-        temp_string += read_uint8();
-        x += 1;
+        l = p_buffer_end - p_index_total;
     }
 
-    // read remaining buffer
-    while (x < 4 * s_len)
-    {
-        read_uint8();
-        x += 1;
-    }
+    // string is zero padded to 4 byte words, stop at first zero
+    auto *start = reinterpret_cast<const char *>(buffer_at(p_index_total));
+    auto *end = static_cast<const char *>(std::memchr(start, 0, l));
+    std::string_view temp_string(start, end == nullptr ? l : end - start);
+
+    p_index_total += l;
 
     return temp_string;
 }
 
-uint32_t RvmParser::parse_chunk(char *chunk_name)
+std::string RvmParser::read_string()
 {
+    return std::string(read_string_view());
+}
+
+uint64_t RvmParser::parse_chunk(char *chunk_name)
+{
+
+    uint64_t chunk_start = p_index_total;
+
+    if (p_is_streaming)
+    {
+        // make whole chunk readable, header tells us how big it is
+        if (load_window(chunk_start, 24))
+        {
+            uint64_t next_chunk = unwrap_chunk_offset(chunk_start, peek_uint32_be(buffer_at(chunk_start + 16)));
+            load_window(chunk_start, next_chunk - chunk_start);
+        }
+    }
 
     unsigned i = 0;
-    for (i = 0; i < 4 && p_index + 4 <= p_buffer_total_length; i++)
+    for (i = 0; i < 4 && p_index_total + 4 <= p_buffer_end; i++)
     {
         read_uint8();
         read_uint8();
@@ -127,13 +145,13 @@ uint32_t RvmParser::parse_chunk(char *chunk_name)
         chunk_name[i] = ' ';
     }
 
-    if (p_index + 8 <= p_buffer_total_length)
+    if (p_index_total + 8 <= p_buffer_end)
     {
-        auto next_chunk = read_uint32_be();
+        uint32_t next_chunk = read_uint32_be();
 
         read_uint32_be();
 
-        return next_chunk;
+        return unwrap_chunk_offset(chunk_start, next_chunk);
     }
     return 0;
 }
@@ -181,17 +199,112 @@ ColrBlock RvmParser::parse_colr_block()
     return block;
 }
 
+/**
+ * COLR chunks are normally at end of file, after last CNTE and before END:
+ * We find END: and walk back 1 COLR chunk at a time, so colors are known before first root is done
+ * COLR chunks other places in file is picked up by the walker when we get to them
+ * Searches current window, that is whole mapped file or tail of file when streaming
+ */
+void RvmParser::read_trailing_colors()
+{
+    const uint64_t colr_chunk_size = 24 + 12;
+    const uint8_t end_header[16] = {0, 0, 0, 'E', 0, 0, 0, 'N', 0, 0, 0, 'D', 0, 0, 0, ':'};
+    const uint8_t colr_header[16] = {0, 0, 0, 'C', 0, 0, 0, 'O', 0, 0, 0, 'L', 0, 0, 0, 'R'};
+
+    if (p_buffer_end < p_buffer_offset + 16)
+    {
+        return;
+    }
+
+    // END: should be last chunk, but allow some padding after it
+    uint64_t search_start = p_buffer_end - p_buffer_offset > 1024 ? p_buffer_end - 1024 : p_buffer_offset;
+    uint64_t next = p_buffer_end - 16 + 1;
+    bool found_end = false;
+    while (next-- > search_start)
+    {
+        if (std::memcmp(buffer_at(next), end_header, 16) == 0)
+        {
+            found_end = true;
+            break;
+        }
+    }
+
+    if (!found_end)
+    {
+        return;
+    }
+
+    std::vector<uint64_t> colr_chunks;
+    while (next >= p_buffer_offset + colr_chunk_size)
+    {
+        uint64_t offset = next - colr_chunk_size;
+        const uint8_t *chunk = buffer_at(offset);
+        if (std::memcmp(chunk, colr_header, 16) != 0 || unwrap_chunk_offset(offset, peek_uint32_be(chunk + 16)) != next)
+        {
+            break;
+        }
+        colr_chunks.push_back(offset);
+        next = offset;
+    }
+
+    // apply in file order, so last one wins if index is used more than once
+    for (auto it = colr_chunks.rbegin(); it != colr_chunks.rend(); ++it)
+    {
+        const uint8_t *chunk = buffer_at(*it);
+        uint32_t index = peek_uint32_be(chunk + 28);
+        uint8_t cr = chunk[32];
+        uint8_t cg = chunk[33];
+        uint8_t cb = chunk[34];
+
+        p_color_store.p_id_hex[index] = (cr << 16) | (cg << 8) | cb;
+
+        std::cout << "Found color index: " << index << " \tR: " << +cr << " \tG:" << +cg << " \tB:" << +cb << std::endl;
+    }
+}
+
+/**
+ * Streaming from a file, we cant map it, but we can still read the tail of it for colors
+ */
+void RvmParser::read_trailing_colors_from_file(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        return;
+    }
+
+    // 1MB is room for ~29000 COLR chunks
+    uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    uint64_t tail_length = file_size < (1 << 20) ? file_size : (1 << 20);
+    std::vector<uint8_t> tail(tail_length);
+    file.seekg(file_size - tail_length);
+    if (!file.read(reinterpret_cast<char *>(tail.data()), tail_length))
+    {
+        return;
+    }
+
+    p_buffer = tail.data();
+    p_buffer_offset = file_size - tail_length;
+    p_buffer_end = file_size;
+
+    read_trailing_colors();
+
+    p_buffer = nullptr;
+    p_buffer_offset = 0;
+    p_buffer_end = 0;
+}
+
 CntbBlock RvmParser::parse_cntb_block()
 {
     CntbBlock block;
 
     block.version = read_uint32_be();
-    block.name = read_string();
+    block.name = read_string_view();
     for (unsigned i = 0; i < 3; i++)
     {
         block.translation[i] = read_float32_be();
     }
-    block.material = p_color_store.p_id_hex[read_uint32_be()];
+    block.material = read_uint32_be();
     block.opacity = 100; // todo get from parent?
 
     // todo, see if we can get some files created having this..
@@ -211,10 +324,21 @@ CntbBlock RvmParser::parse_cntb_block()
 void RvmParser::parse_prim_block(uint32_t chunk_name_id)
 {
 
-    Arena *a = new Arena();
+    // hidden caps can only be found when all primitives of root are read, so these are kept until then
+    bool defer = p_remove_hidden_caps && !p_is_dry_run;
 
-    Geometry *g = new Geometry();
-    Tessellator *t = new Tessellator();
+    Arena *a = defer ? &p_root_geometry_arena : &p_prim_arena;
+
+    Geometry *g;
+    if (defer)
+    {
+        g = a->alloc<Geometry>();
+    }
+    else
+    {
+        p_prim_geometry = Geometry();
+        g = &p_prim_geometry;
+    }
 
     uint32_t version = read_uint32_be();
     uint32_t kind = read_uint32_be();
@@ -401,14 +525,23 @@ void RvmParser::parse_prim_block(uint32_t chunk_name_id)
     {
         // we hide these for now
         // we dont support lines atm in the viewer, so no point in adding them to glb
-        a->clear();
+        if (!defer)
+        {
+            a->reset();
+        }
+    }
+    else if (defer)
+    {
+        node_prim.triangulation = nullptr;
+        node_prim.geometry = g;
+        p_node.primitives.push_back(std::move(node_prim));
     }
     else
     {
-        auto tri = t->geometry(g, arenaTriangulation, p_tolerance);
+        auto tri = p_tessellator.geometry(g, arenaTriangulation, p_tolerance);
         tri->id = p_node_count_id;
         tri->color = p_node.material_id;
-        a->clear();
+        a->reset();
 
         if (tri->vertices_n > 0 && p_is_dry_run == false)
         {
@@ -419,8 +552,64 @@ void RvmParser::parse_prim_block(uint32_t chunk_name_id)
             p_node.primitives.push_back(std::move(node_prim));
         }
     }
+}
+
+/**
+ * Connects and tessellates primitives kept back by parse_prim_block, when root is read
+ * Primitives without triangles are dropped like parse_prim_block does
+ */
+void RvmParser::tessellate_root_geometries()
+{
+    if (!p_remove_hidden_caps || p_is_dry_run)
+    {
+        return;
+    }
+
+    std::vector<Geometry *> geometries;
+    for (auto &prim : p_nodes.primitives)
+    {
+        if (prim.geometry != nullptr)
+        {
+            geometries.push_back(prim.geometry);
+        }
+    }
+
+    if (geometries.empty())
+    {
+        return;
+    }
+
+    auto connection_count = connect_geometries(&p_root_geometry_arena, geometries.data(), geometries.size(), 0.001f);
+    auto discarded_before = p_tessellator.factory.discardedCaps;
+
+    uint32_t kept = 0;
+    for (size_t n = 0; n < p_nodes.size(); n++)
+    {
+        auto start = kept;
+        for (auto p = p_nodes.prim_start[n]; p < p_nodes.prim_start[n] + p_nodes.prim_count[n]; p++)
+        {
+            auto prim = p_nodes.primitives[p];
+            if (prim.geometry != nullptr)
+            {
+                auto tri = p_tessellator.geometry(prim.geometry, arenaTriangulation, p_tolerance);
+                prim.geometry = nullptr;
+                if (tri == nullptr || tri->vertices_n == 0)
+                {
+                    continue;
+                }
+                tri->id = NodeTable::id(n);
+                tri->color = p_nodes.material_id[n];
+                tri->arena = arenaTriangulation;
+                prim.triangulation = tri;
+            }
+            p_nodes.primitives[kept++] = prim;
+        }
+        p_nodes.prim_start[n] = start;
+        p_nodes.prim_count[n] = kept - start;
+    }
+    p_nodes.primitives.resize(kept);
+
+    std::cout << "Connected primitives: " << connection_count << ", discarded caps: " << (p_tessellator.factory.discardedCaps - discarded_before) << "\n";
 
-    delete a;
-    delete g;
-    delete t;
+    p_root_geometry_arena.clear();
 }
@@ -0,0 +1,338 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include "RvmParser.h"
+#include "rapidjson/include/document.h"
+#include "rapidjson/include/stringbuffer.h"
+#include "rapidjson/include/writer.h"
+
+namespace
+{
+    const uint32_t root_index_version = 2;
+
+    // reads chunk header without moving parser, returns chunk id
+    uint32_t peek_chunk(const uint8_t *chunk, uint64_t offset, uint64_t &next_chunk)
+    {
+        const char chunk_name[4] = {char(chunk[3]), char(chunk[7]), char(chunk[11]), char(chunk[15])};
+        next_chunk = unwrap_chunk_offset(offset, peek_uint32_be(chunk + 16));
+        return chunk_id(chunk_name);
+    }
+}
+
+/**
+ * Uses <rvm file>.rvmidx if it matches the rvm file, else runs pre pass and writes it
+ */
+void RvmParser::init_root_index(const std::string &rvm_filename)
+{
+    std::string index_filename = rvm_filename + ".rvmidx";
+
+    std::error_code ec;
+    auto file_time = static_cast<uint64_t>(std::filesystem::last_write_time(rvm_filename, ec).time_since_epoch().count());
+
+    if (read_root_index(index_filename, file_time))
+    {
+        std::cout << "Root index read: " << index_filename << ", roots: " << p_root_index.size() << std::endl;
+        return;
+    }
+
+    if (!build_root_index())
+    {
+        p_root_index.clear();
+        p_collected_errors.push_back("Unable to build root index");
+        std::cout << "Unable to build root index, file structure is not as expected" << std::endl;
+        return;
+    }
+
+    std::cout << "Root index built, roots: " << p_root_index.size() << std::endl;
+    write_root_index(index_filename, file_time);
+}
+
+/**
+ * Fast pre pass over whole file, only follows next chunk offsets
+ * Records every CNTB down to export level with byte range, name and depth, and every COLR chunk
+ * Nothing is decoded, hashed or triangulated here
+ */
+bool RvmParser::build_root_index()
+{
+    const uint64_t not_indexed = UINT64_MAX;
+
+    // for each open CNTB, position in p_root_index (or not_indexed if below export level)
+    std::vector<uint64_t> open_entries;
+    p_root_index.clear();
+    p_colr_index.clear();
+
+    uint64_t offset = 0;
+    while (offset + 24 <= p_buffer_total_length)
+    {
+        const uint8_t *chunk = p_buffer + offset;
+        uint64_t next_chunk;
+        uint32_t id = peek_chunk(chunk, offset, next_chunk);
+
+        if (next_chunk > p_buffer_total_length)
+        {
+            std::cout << "Root index, chunk points past end of file at: " << offset << std::endl;
+            return false;
+        }
+
+        switch (id)
+        {
+        case chunk_id("CNTB"):
+        {
+            if (open_entries.size() > p_export_level)
+            {
+                open_entries.push_back(not_indexed);
+                break;
+            }
+
+            // version, then string length in words, then zero padded string
+            RootIndexEntry entry;
+            if (offset + 32 <= next_chunk)
+            {
+                uint64_t l = 4 * uint64_t(peek_uint32_be(chunk + 28));
+                l = std::min(l, next_chunk - (offset + 32));
+                auto *start = reinterpret_cast<const char *>(chunk + 32);
+                auto *end = static_cast<const char *>(std::memchr(start, 0, l));
+                entry.name = std::string(start, end == nullptr ? l : end - start);
+            }
+            entry.begin = offset;
+            entry.end = 0;
+            entry.depth = static_cast<uint32_t>(open_entries.size());
+
+            open_entries.push_back(p_root_index.size());
+            p_root_index.push_back(std::move(entry));
+        }
+        break;
+        case chunk_id("CNTE"):
+            if (open_entries.empty())
+            {
+                std::cout << "Root index, CNTE without CNTB at: " << offset << std::endl;
+                return false;
+            }
+            if (open_entries.back() != not_indexed)
+            {
+                p_root_index[open_entries.back()].end = next_chunk;
+            }
+            open_entries.pop_back();
+            break;
+        case chunk_id("COLR"):
+            // version, index, then rgb bytes
+            if (offset + 35 <= next_chunk)
+            {
+                ColrIndexEntry colr;
+                colr.offset = offset;
+                colr.index = peek_uint32_be(chunk + 28);
+                colr.color = (uint32_t(chunk[32]) << 16) | (uint32_t(chunk[33]) << 8) | uint32_t(chunk[34]);
+                p_colr_index.push_back(colr);
+            }
+            break;
+        case chunk_id("END:"):
+            return open_entries.empty();
+        }
+
+        offset = next_chunk;
+    }
+
+    std::cout << "Root index, missing END: chunk" << std::endl;
+    return false;
+}
+
+/**
+ * Finds end of the CNTE matching the CNTB we just read
+ * Only follows next chunk offsets, so nothing in subtree is decoded, hashed or triangulated
+ * COLR chunks on the way are still applied, so roots after a skipped root gets same colors as if we read it
+ */
+bool RvmParser::find_subtree_end(uint64_t &end)
+{
+    uint32_t depth = 1;
+    uint64_t offset = p_index_total;
+    // when streaming, this only loads the chunk headers, rest of subtree is never copied
+    while (load_window(offset, 24))
+    {
+        uint64_t next_chunk;
+        uint32_t id = peek_chunk(buffer_at(offset), offset, next_chunk);
+
+        if (next_chunk > p_buffer_total_length)
+        {
+            return false;
+        }
+
+        switch (id)
+        {
+        case chunk_id("CNTB"):
+            depth += 1;
+            break;
+        case chunk_id("CNTE"):
+            depth -= 1;
+            if (depth == 0)
+            {
+                end = next_chunk;
+                return true;
+            }
+            break;
+        case chunk_id("COLR"):
+            if (offset + 35 <= next_chunk && load_window(offset, 35))
+            {
+                const uint8_t *chunk = buffer_at(offset);
+                p_color_store.p_id_hex[peek_uint32_be(chunk + 28)] = (uint32_t(chunk[32]) << 16) | (uint32_t(chunk[33]) << 8) | uint32_t(chunk[34]);
+            }
+            break;
+        case chunk_id("END:"):
+            return false;
+        }
+
+        offset = next_chunk;
+    }
+
+    return false;
+}
+
+/**
+ * Moves parser past the CNTE matching the CNTB we just read
+ */
+bool RvmParser::skip_subtree()
+{
+    uint64_t end;
+    if (!find_subtree_end(end))
+    {
+        return false;
+    }
+
+    p_index_total = end;
+    p_next_chunk = end;
+    return true;
+}
+
+bool RvmParser::read_root_index(const std::string &filename, uint64_t file_time)
+{
+    using namespace rapidjson;
+
+    std::ifstream file_read(filename, std::ios::in | std::ios::binary);
+    if (!file_read.is_open())
+    {
+        return false;
+    }
+    std::string content((std::istreambuf_iterator<char>(file_read)), std::istreambuf_iterator<char>());
+
+    Document document;
+    document.Parse(content.c_str(), content.length());
+    if (document.HasParseError() || !document.IsObject())
+    {
+        return false;
+    }
+
+    // index is only valid for the exact file it was made from, and must go at least down to our level
+    if (!document.HasMember("version") || !document["version"].IsUint() || document["version"].GetUint() != root_index_version ||
+        !document.HasMember("file_size") || !document["file_size"].IsUint64() || document["file_size"].GetUint64() != p_buffer_total_length ||
+        !document.HasMember("file_time") || !document["file_time"].IsUint64() || document["file_time"].GetUint64() != file_time ||
+        !document.HasMember("level") || !document["level"].IsUint() || document["level"].GetUint() < p_export_level ||
+        !document.HasMember("roots") || !document["roots"].IsArray() ||
+        !document.HasMember("colors") || !document["colors"].IsArray())
+    {
+        std::cout << "Root index is outdated, rebuilding: " << filename << std::endl;
+        return false;
+    }
+
+    p_root_index.clear();
+    for (const auto &root : document["roots"].GetArray())
+    {
+        if (!root.IsObject() ||
+            !root.HasMember("name") || !root["name"].IsString() ||
+            !root.HasMember("begin") || !root["begin"].IsUint64() ||
+            !root.HasMember("end") || !root["end"].IsUint64() ||
+            !root.HasMember("depth") || !root["depth"].IsUint())
+        {
+            p_root_index.clear();
+            return false;
+        }
+
+        RootIndexEntry entry;
+        entry.depth = root["depth"].GetUint();
+        if (entry.depth > p_export_level)
+        {
+            continue;
+        }
+        entry.name = std::string(root["name"].GetString(), root["name"].GetStringLength());
+        entry.begin = root["begin"].GetUint64();
+        entry.end = root["end"].GetUint64();
+        p_root_index.push_back(std::move(entry));
+    }
+
+    // [offset, index, color] for each COLR chunk
+    p_colr_index.clear();
+    for (const auto &colr : document["colors"].GetArray())
+    {
+        if (!colr.IsArray() || colr.Size() != 3 || !colr[0].IsUint64() || !colr[1].IsUint() || !colr[2].IsUint())
+        {
+            p_root_index.clear();
+            p_colr_index.clear();
+            return false;
+        }
+
+        ColrIndexEntry entry;
+        entry.offset = colr[0].GetUint64();
+        entry.index = colr[1].GetUint();
+        entry.color = colr[2].GetUint();
+        p_colr_index.push_back(entry);
+    }
+
+    return true;
+}
+
+void RvmParser::write_root_index(const std::string &filename, uint64_t file_time)
+{
+    using namespace rapidjson;
+
+    Document document;
+    document.SetObject();
+    Document::AllocatorType &allocator = document.GetAllocator();
+
+    document.AddMember("version", root_index_version, allocator);
+    document.AddMember("file_size", Value().SetUint64(p_buffer_total_length), allocator);
+    document.AddMember("file_time", Value().SetUint64(file_time), allocator);
+    document.AddMember("level", static_cast<uint32_t>(p_export_level), allocator);
+
+    Value roots(kArrayType);
+    for (const auto &entry : p_root_index)
+    {
+        Value rootObject(kObjectType);
+        rootObject.AddMember("name", Value().SetString(entry.name.c_str(), entry.name.length(), allocator), allocator);
+        rootObject.AddMember("begin", Value().SetUint64(entry.begin), allocator);
+        rootObject.AddMember("end", Value().SetUint64(entry.end), allocator);
+        rootObject.AddMember("depth", entry.depth, allocator);
+        roots.PushBack(rootObject, allocator);
+    }
+    document.AddMember("roots", roots, allocator);
+
+    Value colors(kArrayType);
+    for (const auto &entry : p_colr_index)
+    {
+        Value colr(kArrayType);
+        colr.PushBack(Value().SetUint64(entry.offset), allocator);
+        colr.PushBack(entry.index, allocator);
+        colr.PushBack(entry.color, allocator);
+        colors.PushBack(colr, allocator);
+    }
+    document.AddMember("colors", colors, allocator);
+
+    StringBuffer buffer;
+    Writer<StringBuffer> writer(buffer);
+    document.Accept(writer);
+
+    std::ofstream file_write;
+    file_write.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (file_write.is_open())
+    {
+        file_write.write((char *)buffer.GetString(), buffer.GetSize());
+        file_write.close();
+        std::cout << "File created: " << filename << std::endl;
+    }
+    else
+    {
+        // rvm folder might be read only, we can still use index in memory
+        std::cerr << "Failed writing to file: " << filename << std::endl;
+    }
+}
@@ -0,0 +1,204 @@
+#include "StreamReader.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+bool StreamReader::open(const std::string &filename, size_t block_size, size_t block_count)
+{
+    close();
+
+    if (filename == "-")
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        p_file = stdin;
+        p_owns_file = false;
+    }
+    else
+    {
+        p_file = std::fopen(filename.c_str(), "rb");
+        p_owns_file = true;
+        if (p_file == nullptr)
+        {
+            return false;
+        }
+    }
+
+    // we read big blocks, no need for stdio to buffer them too
+    std::setvbuf(p_file, nullptr, _IONBF, 0);
+
+    p_blocks.resize(block_count < 2 ? 2 : block_count);
+    for (auto &block : p_blocks)
+    {
+        block.data.resize(block_size);
+        block.length = 0;
+    }
+
+    p_filled_count = 0;
+    p_released_count = 0;
+    p_end_of_stream = false;
+    p_stop = false;
+    p_block_position = 0;
+    p_window.clear();
+    p_window_offset = 0;
+    p_stream_offset = 0;
+
+    p_thread = std::thread(&StreamReader::read_ahead, this);
+
+    return true;
+}
+
+void StreamReader::close()
+{
+    if (p_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(p_mutex);
+            p_stop = true;
+        }
+        p_block_released.notify_all();
+        p_thread.join();
+    }
+
+    if (p_file != nullptr && p_owns_file)
+    {
+        std::fclose(p_file);
+    }
+    p_file = nullptr;
+
+    p_blocks.clear();
+    p_blocks.shrink_to_fit();
+    p_window.clear();
+    p_window.shrink_to_fit();
+}
+
+StreamReader::~StreamReader()
+{
+    close();
+}
+
+/**
+ * Runs on reader thread, fills blocks in ring order as long as consumer have released them
+ */
+void StreamReader::read_ahead()
+{
+    while (true)
+    {
+        Block *block;
+        {
+            std::unique_lock<std::mutex> lock(p_mutex);
+            p_block_released.wait(lock, [this]
+                                  { return p_stop || p_filled_count - p_released_count < p_blocks.size(); });
+            if (p_stop)
+            {
+                return;
+            }
+            block = &p_blocks[p_filled_count % p_blocks.size()];
+        }
+
+        // pipes return less than asked for, keep going until block is full or stream ends
+        size_t length = 0;
+        bool end_of_stream = false;
+        while (length < block->data.size())
+        {
+            auto n = std::fread(block->data.data() + length, 1, block->data.size() - length, p_file);
+            length += n;
+            if (n == 0)
+            {
+                end_of_stream = true;
+                break;
+            }
+        }
+        block->length = length;
+
+        {
+            std::lock_guard<std::mutex> lock(p_mutex);
+            p_filled_count += 1;
+            p_end_of_stream = end_of_stream;
+        }
+        p_block_filled.notify_one();
+
+        if (end_of_stream)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Moves length bytes from filled blocks into window (or just past them), blocks are given back to reader when used up
+ */
+bool StreamReader::consume(uint64_t length, bool copy_to_window)
+{
+    while (length > 0)
+    {
+        Block *block;
+        {
+            std::unique_lock<std::mutex> lock(p_mutex);
+            p_block_filled.wait(lock, [this]
+                                { return p_filled_count > p_released_count || p_end_of_stream; });
+            if (p_filled_count == p_released_count)
+            {
+                return false;
+            }
+            block = &p_blocks[p_released_count % p_blocks.size()];
+        }
+
+        uint64_t available = block->length - p_block_position;
+        auto n = static_cast<size_t>(length < available ? length : available);
+        if (copy_to_window)
+        {
+            auto *data = block->data.data() + p_block_position;
+            p_window.insert(p_window.end(), data, data + n);
+        }
+        p_block_position += n;
+        p_stream_offset += n;
+        length -= n;
+
+        if (p_block_position == block->length)
+        {
+            {
+                std::lock_guard<std::mutex> lock(p_mutex);
+                p_released_count += 1;
+            }
+            p_block_position = 0;
+            p_block_released.notify_one();
+        }
+    }
+
+    return true;
+}
+
+const uint8_t *StreamReader::fetch(uint64_t offset, uint64_t length)
+{
+    if (p_file == nullptr || offset < p_window_offset)
+    {
+        return nullptr;
+    }
+
+    if (offset >= p_stream_offset)
+    {
+        // nothing we have is needed anymore, skip ahead without copying
+        p_window.clear();
+        if (!consume(offset - p_stream_offset, false))
+        {
+            return nullptr;
+        }
+    }
+    else if (offset > p_window_offset)
+    {
+        p_window.erase(p_window.begin(), p_window.begin() + static_cast<size_t>(offset - p_window_offset));
+    }
+    p_window_offset = offset;
+
+    uint64_t have = p_stream_offset - offset;
+    if (have < length && !consume(length - have, true))
+    {
+        return nullptr;
+    }
+
+    return p_window.data();
+}
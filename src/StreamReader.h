@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Sequential input for sources we cant mmap (stdin, fifo) or dont want to (slow network mounts)
+ * A background thread reads ahead into a ring of large blocks, so waiting on io overlaps with parsing
+ * Parser asks for byte ranges with fetch, these are copied into a small window so a chunk is always contiguous
+ */
+class StreamReader
+{
+public:
+    StreamReader() = default;
+    StreamReader(const StreamReader &) = delete;
+    StreamReader &operator=(const StreamReader &) = delete;
+    ~StreamReader();
+
+    // "-" is stdin
+    bool open(const std::string &filename, size_t block_size = 16 << 20, size_t block_count = 4);
+    void close();
+
+    // returns [offset, offset + length) as contiguous memory, valid until next fetch
+    // offset can not be before offset of last fetch, returns nullptr if stream ends before offset + length
+    const uint8_t *fetch(uint64_t offset, uint64_t length);
+
+private:
+    struct Block
+    {
+        std::vector<uint8_t> data;
+        size_t length = 0;
+    };
+
+    std::FILE *p_file = nullptr;
+    bool p_owns_file = false;
+    std::thread p_thread;
+
+    // shared with reader thread
+    std::mutex p_mutex;
+    std::condition_variable p_block_filled;
+    std::condition_variable p_block_released;
+    std::vector<Block> p_blocks;
+    uint64_t p_filled_count = 0;
+    uint64_t p_released_count = 0;
+    bool p_end_of_stream = false;
+    bool p_stop = false;
+
+    // consumer side only
+    size_t p_block_position = 0;
+    std::vector<uint8_t> p_window;
+    uint64_t p_window_offset = 0;
+    uint64_t p_stream_offset = 0;
+
+    void read_ahead();
+    bool consume(uint64_t length, bool copy_to_window);
+};
@@ -24,15 +24,115 @@ namespace
 
 }
 
-Tessellator::~Tessellator()
+bool TessellationKey::operator==(const TessellationKey &other) const
 {
-  delete factory;
+  return std::memcmp(words, other.words, sizeof(words)) == 0;
+}
+
+size_t TessellationKeyHash::operator()(const TessellationKey &key) const
+{
+  uint64_t h = 0;
+  for (auto word : key.words)
+  {
+    h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+  }
+  return static_cast<size_t>(h);
+}
+
+namespace
+{
+
+  // scale only changes number of segments, 0.1% steps keeps sagitta error within 0.1% of tolerance
+  const float scale_bucket_step = std::log1p(0.001f);
+
+  // returns false if primitive cant be cached
+  // cached entry is tessellated at key_scale, so it does not depend on which instance came first
+  bool makeKey(const Geometry *geo, float scale, float tolerance, TessellationKey &key, float &key_scale)
+  {
+    // caps are discarded depending on neighbours, so connected primitives are not the same
+    for (auto *connection : geo->connections)
+    {
+      if (connection != nullptr)
+      {
+        return false;
+      }
+    }
+
+    std::memset(&key, 0, sizeof(key));
+    key.words[0] = static_cast<uint32_t>(geo->kind);
+    std::memcpy(&key.words[2], &tolerance, sizeof(float));
+    std::memcpy(&key.words[3], &geo->sampleStartAngle, sizeof(float));
+
+    static_assert(sizeof(geo->snout) <= sizeof(key.words) - 4 * sizeof(uint32_t), "parameters must fit in key");
+
+    key_scale = scale;
+    bool uses_scale = true;
+    switch (geo->kind)
+    {
+    case Geometry::Kind::Pyramid:
+      std::memcpy(&key.words[4], &geo->pyramid, sizeof(geo->pyramid));
+      uses_scale = false;
+      break;
+    case Geometry::Kind::Box:
+      std::memcpy(&key.words[4], &geo->box, sizeof(geo->box));
+      uses_scale = false;
+      break;
+    case Geometry::Kind::RectangularTorus:
+      std::memcpy(&key.words[4], &geo->rectangularTorus, sizeof(geo->rectangularTorus));
+      break;
+    case Geometry::Kind::CircularTorus:
+      std::memcpy(&key.words[4], &geo->circularTorus, sizeof(geo->circularTorus));
+      break;
+    case Geometry::Kind::EllipticalDish:
+      std::memcpy(&key.words[4], &geo->ellipticalDish, sizeof(geo->ellipticalDish));
+      break;
+    case Geometry::Kind::SphericalDish:
+      std::memcpy(&key.words[4], &geo->sphericalDish, sizeof(geo->sphericalDish));
+      break;
+    case Geometry::Kind::Snout:
+      std::memcpy(&key.words[4], &geo->snout, sizeof(geo->snout));
+      break;
+    case Geometry::Kind::Cylinder:
+      std::memcpy(&key.words[4], &geo->cylinder, sizeof(geo->cylinder));
+      break;
+    case Geometry::Kind::Sphere:
+      std::memcpy(&key.words[4], &geo->sphere, sizeof(geo->sphere));
+      break;
+    default:
+      // facet groups are unique, lines are not tessellated
+      return false;
+    }
+
+    if (uses_scale)
+    {
+      if (!std::isfinite(scale) || scale <= 0.f)
+      {
+        return false;
+      }
+      auto bucket = static_cast<int32_t>(std::lround(std::log(scale) / scale_bucket_step));
+      key.words[1] = static_cast<uint32_t>(bucket);
+      key_scale = std::exp(static_cast<float>(bucket) * scale_bucket_step);
+    }
+
+    return true;
+  }
+
+}
+
+void Tessellator::trim_cache()
+{
+  if (cache_size > cache_limit)
+  {
+    cache.clear();
+    cache_arena.clear();
+    cache_size = 0;
+  }
 }
 
 Triangulation *Tessellator::geometry(Geometry *geo, Arena *arena, float tolerance)
 {
   Triangulation *tri = nullptr;
-  TriangulationFactory factory;
   factory.tolerance = tolerance;
   // No need to tessellate lines.
   if (geo->kind == Geometry::Kind::Line)
@@ -42,6 +142,53 @@ Triangulation *Tessellator::geometry(Geometry *geo, Arena *arena, float toleranc
 
   auto scale = getScale(geo->M_3x4);
 
+  // local space triangulation, vertices are transformed into tri
+  Triangulation *local = nullptr;
+
+  TessellationKey key;
+  float key_scale;
+  if (use_cache && makeKey(geo, scale, tolerance, key, key_scale))
+  {
+    auto search = cache.find(key);
+    if (search != cache.end())
+    {
+      local = search->second;
+    }
+    else
+    {
+      local = tessellate(geo, &cache_arena, key_scale);
+      cache.emplace(key, local);
+      cache_size += sizeof(Triangulation) + 6 * sizeof(float) * local->vertices_n + 3 * sizeof(uint32_t) * local->triangles_n;
+    }
+
+    // indices and normals are shared with cache, only positions are per instance
+    tri = arena->alloc<Triangulation>();
+    *tri = *local;
+    tri->vertices = (float *)arena->alloc(3 * sizeof(float) * local->vertices_n);
+
+    auto transform = arena->alloc<Mat3x4f>();
+    *transform = geo->M_3x4;
+    tri->shape = local;
+    tri->transform = transform;
+  }
+  else
+  {
+    tri = tessellate(geo, arena, scale);
+    local = tri;
+  }
+
+  // rvm files are Z up, but glb files use Y, so we rotate while placing
+  Mat3x4d M = zUpToYUp(makeMat3x4d(geo->M_3x4.data));
+
+  tri->bbox = transformPositions(M, local->vertices, tri->vertices, tri->vertices_n);
+
+  return tri;
+}
+
+Triangulation *Tessellator::tessellate(Geometry *geo, Arena *arena, float scale)
+{
+  Triangulation *tri = nullptr;
+
   switch (geo->kind)
   {
   case Geometry::Kind::Pyramid:
@@ -100,30 +247,5 @@ Triangulation *Tessellator::geometry(Geometry *geo, Arena *arena, float toleranc
     break;
   }
 
-  BBox3f box = createEmptyBBox3f();
-  for (unsigned i = 0; i < tri->vertices_n; i++)
-  {
-    engulf(box, makeVec3f(tri->vertices + 3 * i));
-  }
-
-  Mat3x4d M = makeMat3x4d(geo->M_3x4.data);
-
-  // todo
-  /* M.m03 -= localOrigin.x;
-  M.m13 -= localOrigin.y;
-  M.m23 -= localOrigin.z; */
-
-  size_t vertexCount = tri->vertices_n;
-  auto copy = tri->vertices;
-  for (size_t i = 0; i < vertexCount; i++)
-  {
-    auto u = 3 * i;
-    auto a = makeVec3f(mul(M, makeVec3d(tri->vertices + u)));
-
-    copy[u] = a.x;
-    copy[u + 1] = a.y;
-    copy[u + 2] = a.z;
-  }
-
   return tri;
 }
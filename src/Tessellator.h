@@ -4,11 +4,26 @@
  */
 
 #pragma once
+#include <cstdint>
 #include <vector>
+#include <unordered_map>
 #include "LinAlg.h"
 #include "Arena.h"
 #include "TriangulationFactory.h"
 
+// kind, parameters, tolerance and scale bucket of a primitive, all as raw 32 bit words
+struct TessellationKey
+{
+  uint32_t words[13];
+
+  bool operator==(const TessellationKey &other) const;
+};
+
+struct TessellationKeyHash
+{
+  size_t operator()(const TessellationKey &key) const;
+};
+
 class Tessellator
 {
 public:
@@ -16,9 +31,24 @@ public:
   Tessellator(const Tessellator &) = delete;
   Tessellator &operator=(const Tessellator &) = delete;
 
-  ~Tessellator();
-
   Triangulation *geometry(struct Geometry *geometry, Arena *arena, float tolerance);
-  Triangulation *tri = nullptr;
-  TriangulationFactory *factory = nullptr;
+
+  // drops cached triangulations if cache is over its limit
+  // only call when no triangulation from arena given to geometry is in use anymore
+  void trim_cache();
+
+  // kept between primitives, so its scratch vectors only grow a few times
+  TriangulationFactory factory;
+
+  // same primitive with same size is only tessellated once, instances only transforms the local vertices
+  // cached primitives are tessellated at scale of their 0.1% bucket, so output is a little different without cache
+  bool use_cache = false;
+  size_t cache_limit = 256 * 1024 * 1024;
+  Arena cache_arena;
+
+private:
+  std::unordered_map<TessellationKey, Triangulation *, TessellationKeyHash> cache;
+  size_t cache_size = 0;
+
+  Triangulation *tessellate(struct Geometry *geometry, Arena *arena, float scale);
 };
\ No newline at end of file
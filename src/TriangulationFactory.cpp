@@ -48,8 +48,6 @@ namespace
   Interface getInterface(const Geometry *geo, unsigned o)
   {
     Interface interface;
-    auto *connection = geo->connections[o];
-    auto ix = connection->geo[0] == geo ? 1 : 0;
     auto scale = getScale(geo->M_3x4);
     switch (geo->kind)
     {
@@ -106,6 +104,7 @@ namespace
           {makeVec3f(xm, yp, zm), makeVec3f(xm, yp, zp), makeVec3f(xp, yp, zp), makeVec3f(xp, yp, zm)},
           {makeVec3f(xm, yp, zm), makeVec3f(xp, yp, zm), makeVec3f(xp, ym, zm), makeVec3f(xm, ym, zm)},
           {makeVec3f(xm, ym, zp), makeVec3f(xp, ym, zp), makeVec3f(xp, yp, zp), makeVec3f(xm, yp, zp)}};
+      interface.kind = Interface::Kind::Square;
       for (unsigned k = 0; k < 4; k++)
         interface.square.p[k] = mul(geo->M_3x4, V[o][k]);
       break;
@@ -120,6 +119,7 @@ namespace
           {tor.inner_radius, h2},
           {tor.outer_radius, h2},
       };
+      interface.kind = Interface::Kind::Square;
       if (o == 0)
       {
         for (unsigned k = 0; k < 4; k++)
@@ -159,7 +159,7 @@ namespace
     }
     case Geometry::Kind::Snout:
       interface.kind = Interface::Kind::Circular;
-      interface.circular.radius = scale * (connection->offset[ix] == 0 ? geo->snout.radius_b : geo->snout.radius_t);
+      interface.circular.radius = scale * (o == 0 ? geo->snout.radius_b : geo->snout.radius_t);
       break;
     case Geometry::Kind::Cylinder:
       interface.kind = Interface::Kind::Circular;
@@ -302,6 +302,221 @@ namespace
     return l;
   }
 
+  // sagittaBasedSegmentCount never gives more than this, so full circles can be looked up
+  const unsigned circleTableMaxSamples = 100;
+
+  // cos, sin of (twopi / n) * i for n = 1 to circleTableMaxSamples, same math as the loops it replaces
+  // built once and only read after that, so all factories and threads can share it
+  struct CircleTable
+  {
+    std::vector<float> samples;
+    std::vector<uint32_t> offset; // samples of n starts at offset[n]
+
+    CircleTable()
+    {
+      offset.resize(circleTableMaxSamples + 1);
+      for (unsigned n = 1; n <= circleTableMaxSamples; n++)
+      {
+        offset[n] = static_cast<uint32_t>(samples.size());
+        for (unsigned i = 0; i < n; i++)
+        {
+          samples.push_back(std::cos((twopi / n) * i));
+          samples.push_back(std::sin((twopi / n) * i));
+        }
+      }
+    }
+  };
+
+  const CircleTable &circleTable()
+  {
+    static const CircleTable table;
+    return table;
+  }
+
+}
+
+namespace
+{
+
+  // size is kept in front of each block, so realloc knows how much to copy
+  const size_t tessHeaderSize = 8;
+
+  void *tessArenaAlloc(void *userData, unsigned int size)
+  {
+    auto *arena = static_cast<Arena *>(userData);
+    auto *block = static_cast<uint8_t *>(arena->alloc(tessHeaderSize + size));
+    std::memcpy(block, &size, sizeof(size));
+    return block + tessHeaderSize;
+  }
+
+  void *tessArenaRealloc(void *userData, void *ptr, unsigned int size)
+  {
+    auto *block = tessArenaAlloc(userData, size);
+    if (ptr != nullptr)
+    {
+      unsigned int old_size;
+      std::memcpy(&old_size, static_cast<uint8_t *>(ptr) - tessHeaderSize, sizeof(old_size));
+      std::memcpy(block, ptr, std::min(old_size, size));
+    }
+    return block;
+  }
+
+  void tessArenaFree(void * /*userData*/, void * /*ptr*/)
+  {
+    // all of it goes when arena is reset
+  }
+
+  // checks if single contour polygon is flat and strictly convex, so a fan gives same surface as libtess2
+  // contours with a vertex on a straight edge goes to libtess2, fanning would give zero area triangles and
+  // leaving the vertex out would give T-junctions with the neighbour facet that has a vertex there
+  bool isPlanarConvex(const float *V, unsigned n)
+  {
+
+    // newell normal
+    double N[3] = {0.0, 0.0, 0.0};
+    double lo[3] = {V[0], V[1], V[2]};
+    double hi[3] = {V[0], V[1], V[2]};
+    for (unsigned i = 0; i < n; i++)
+    {
+      const float *a = V + 3 * i;
+      const float *b = V + 3 * ((i + 1) % n);
+      N[0] += (double(a[1]) - b[1]) * (double(a[2]) + b[2]);
+      N[1] += (double(a[2]) - b[2]) * (double(a[0]) + b[0]);
+      N[2] += (double(a[0]) - b[0]) * (double(a[1]) + b[1]);
+      for (unsigned k = 0; k < 3; k++)
+      {
+        lo[k] = std::min(lo[k], double(a[k]));
+        hi[k] = std::max(hi[k], double(a[k]));
+      }
+    }
+    double length = std::sqrt(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+    double diagonal = std::sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) + (hi[2] - lo[2]) * (hi[2] - lo[2]));
+    if (!(length > 1e-12 * diagonal * diagonal))
+    {
+      return false;
+    }
+    for (unsigned k = 0; k < 3; k++)
+    {
+      N[k] /= length;
+    }
+
+    // all corners close to plane through first vertex
+    const double flat = 1e-5 * diagonal;
+    for (unsigned i = 1; i < n; i++)
+    {
+      const float *a = V + 3 * i;
+      double d = N[0] * (double(a[0]) - V[0]) + N[1] * (double(a[1]) - V[1]) + N[2] * (double(a[2]) - V[2]);
+      if (std::abs(d) > flat)
+      {
+        return false;
+      }
+    }
+
+    // project on plane of largest normal component
+    unsigned axis = std::abs(N[0]) > std::abs(N[1]) ? (std::abs(N[0]) > std::abs(N[2]) ? 0 : 2) : (std::abs(N[1]) > std::abs(N[2]) ? 1 : 2);
+    unsigned u = (axis + 1) % 3;
+    unsigned v = (axis + 2) % 3;
+    double orientation = N[axis] > 0.0 ? 1.0 : -1.0;
+
+    // convex if every corner turns the same way, and edges only changes direction twice along each axis
+    // (locally convex star shapes wraps around more than once, and changes direction more often)
+    const double straight = 1e-12 * diagonal * diagonal;
+    int u_changes = 0;
+    int v_changes = 0;
+    int u_sign = 0;
+    int v_sign = 0;
+    for (unsigned i = 0; i < n; i++)
+    {
+      const float *a = V + 3 * i;
+      const float *b = V + 3 * ((i + 1) % n);
+      const float *c = V + 3 * ((i + 2) % n);
+      double e0u = double(b[u]) - a[u];
+      double e0v = double(b[v]) - a[v];
+      double e1u = double(c[u]) - b[u];
+      double e1v = double(c[v]) - b[v];
+
+      double turn = orientation * (e0u * e1v - e0v * e1u);
+      if (!(turn > straight))
+      {
+        return false;
+      }
+
+      int su = e0u > 0.0 ? 1 : (e0u < 0.0 ? -1 : 0);
+      if (su != 0)
+      {
+        u_changes += (u_sign != 0 && su != u_sign) ? 1 : 0;
+        u_sign = su;
+      }
+      int sv = e0v > 0.0 ? 1 : (e0v < 0.0 ? -1 : 0);
+      if (sv != 0)
+      {
+        v_changes += (v_sign != 0 && sv != v_sign) ? 1 : 0;
+        v_sign = sv;
+      }
+    }
+
+    // count change between last and first edge too
+    for (unsigned i = 0; i < n; i++)
+    {
+      const float *a = V + 3 * i;
+      const float *b = V + 3 * ((i + 1) % n);
+      int su = b[u] > a[u] ? 1 : (b[u] < a[u] ? -1 : 0);
+      if (su != 0)
+      {
+        u_changes += su != u_sign ? 1 : 0;
+        break;
+      }
+    }
+    for (unsigned i = 0; i < n; i++)
+    {
+      const float *a = V + 3 * i;
+      const float *b = V + 3 * ((i + 1) % n);
+      int sv = b[v] > a[v] ? 1 : (b[v] < a[v] ? -1 : 0);
+      if (sv != 0)
+      {
+        v_changes += sv != v_sign ? 1 : 0;
+        break;
+      }
+    }
+
+    return u_changes <= 2 && v_changes <= 2;
+  }
+
+}
+
+TriangulationFactory::TriangulationFactory()
+{
+  // polygons are small, so small buckets keeps memory we touch low
+  tessArena.page_size = 1024 * 1024;
+
+  std::memset(&tessAlloc, 0, sizeof(tessAlloc));
+  tessAlloc.memalloc = tessArenaAlloc;
+  tessAlloc.memrealloc = tessArenaRealloc;
+  tessAlloc.memfree = tessArenaFree;
+  tessAlloc.userData = &tessArena;
+  tessAlloc.meshEdgeBucketSize = 64;
+  tessAlloc.meshVertexBucketSize = 64;
+  tessAlloc.meshFaceBucketSize = 32;
+  tessAlloc.dictNodeBucketSize = 64;
+  tessAlloc.regionBucketSize = 32;
+  tessAlloc.extraVertices = 8;
+}
+
+const float *TriangulationFactory::circleSamples(std::vector<float> &scratch, unsigned n, float startAngle)
+{
+  if (startAngle == 0.f && 0 < n && n <= circleTableMaxSamples)
+  {
+    auto &table = circleTable();
+    return table.samples.data() + table.offset[n];
+  }
+
+  scratch.resize(2 * n);
+  for (unsigned i = 0; i < n; i++)
+  {
+    scratch[2 * i + 0] = std::cos((twopi / n) * i + startAngle);
+    scratch[2 * i + 1] = std::sin((twopi / n) * i + startAngle);
+  }
+  return scratch.data();
 }
 
 unsigned TriangulationFactory::sagittaBasedSegmentCount(float arc, float radius, float scale)
@@ -703,12 +918,7 @@ Triangulation *TriangulationFactory::circularTorus(Arena *arena, const Geometry
     t0[2 * i + 1] = std::sin((ct.angle / (samples_l - 1.f)) * i);
   }
 
-  t1.resize(2 * samples_s);
-  for (unsigned i = 0; i < samples_s; i++)
-  {
-    t1[2 * i + 0] = std::cos((twopi / samples_s) * i + geo->sampleStartAngle);
-    t1[2 * i + 1] = std::sin((twopi / samples_s) * i + geo->sampleStartAngle);
-  }
+  const float *circle = circleSamples(t1, samples_s, geo->sampleStartAngle);
 
   tri->vertices_n = ((shell ? samples_l : 0) + (cap[0] ? 1 : 0) + (cap[1] ? 1 : 0)) * samples_s;
   tri->vertices = (float *)arena->alloc(3 * sizeof(float) * tri->vertices_n);
@@ -726,11 +936,11 @@ Triangulation *TriangulationFactory::circularTorus(Arena *arena, const Geometry
       for (unsigned v = 0; v < samples_s; v++)
       {
 
-        tri->vertices[l++] = ((ct.radius * t1[2 * v + 0] + ct.offset) * t0[2 * u + 0]);
+        tri->vertices[l++] = ((ct.radius * circle[2 * v + 0] + ct.offset) * t0[2 * u + 0]);
 
-        tri->vertices[l++] = ((ct.radius * t1[2 * v + 0] + ct.offset) * t0[2 * u + 1]);
+        tri->vertices[l++] = ((ct.radius * circle[2 * v + 0] + ct.offset) * t0[2 * u + 1]);
 
-        tri->vertices[l++] = ct.radius * t1[2 * v + 1];
+        tri->vertices[l++] = ct.radius * circle[2 * v + 1];
       }
     }
   }
@@ -739,11 +949,11 @@ Triangulation *TriangulationFactory::circularTorus(Arena *arena, const Geometry
     for (unsigned v = 0; v < samples_s; v++)
     {
 
-      tri->vertices[l++] = ((ct.radius * t1[2 * v + 0] + ct.offset) * t0[0]);
+      tri->vertices[l++] = ((ct.radius * circle[2 * v + 0] + ct.offset) * t0[0]);
 
-      tri->vertices[l++] = ((ct.radius * t1[2 * v + 0] + ct.offset) * t0[1]);
+      tri->vertices[l++] = ((ct.radius * circle[2 * v + 0] + ct.offset) * t0[1]);
 
-      tri->vertices[l++] = ct.radius * t1[2 * v + 1];
+      tri->vertices[l++] = ct.radius * circle[2 * v + 1];
     }
   }
   if (cap[1])
@@ -752,11 +962,11 @@ Triangulation *TriangulationFactory::circularTorus(Arena *arena, const Geometry
     for (unsigned v = 0; v < samples_s; v++)
     {
 
-      tri->vertices[l++] = ((ct.radius * t1[2 * v + 0] + ct.offset) * t0[m + 0]);
+      tri->vertices[l++] = ((ct.radius * circle[2 * v + 0] + ct.offset) * t0[m + 0]);
 
-      tri->vertices[l++] = ((ct.radius * t1[2 * v + 0] + ct.offset) * t0[m + 1]);
+      tri->vertices[l++] = ((ct.radius * circle[2 * v + 0] + ct.offset) * t0[m + 1]);
 
-      tri->vertices[l++] = ct.radius * t1[2 * v + 1];
+      tri->vertices[l++] = ct.radius * circle[2 * v + 1];
     }
   }
   assert(l == 3 * tri->vertices_n);
@@ -845,21 +1055,16 @@ Triangulation *TriangulationFactory::snout(Arena *arena, const Geometry *geo, fl
     }
   }
 
-  t0.resize(2 * samples);
-  for (unsigned i = 0; i < samples; i++)
-  {
-    t0[2 * i + 0] = std::cos((twopi / samples) * i + geo->sampleStartAngle);
-    t0[2 * i + 1] = std::sin((twopi / samples) * i + geo->sampleStartAngle);
-  }
+  const float *circle = circleSamples(t0, samples, geo->sampleStartAngle);
   t1.resize(2 * samples);
   for (unsigned i = 0; i < 2 * samples; i++)
   {
-    t1[i] = sn.radius_b * t0[i];
+    t1[i] = sn.radius_b * circle[i];
   }
   t2.resize(2 * samples);
   for (unsigned i = 0; i < 2 * samples; i++)
   {
-    t2[i] = sn.radius_t * t0[i];
+    t2[i] = sn.radius_t * circle[i];
   }
 
   float h2 = 0.5f * sn.height;
@@ -887,7 +1092,7 @@ Triangulation *TriangulationFactory::snout(Arena *arena, const Geometry *geo, fl
       float yt = t2[2 * i + 1] + oy;
       float zt = h2 + mt[0] * t2[2 * i + 0] + mt[1] * t2[2 * i + 1];
 
-      float s = (sn.offset[0] * t0[2 * i + 0] + sn.offset[1] * t0[2 * i + 1]);
+      float s = (sn.offset[0] * circle[2 * i + 0] + sn.offset[1] * circle[2 * i + 1]);
 
       l = vertex(tri->vertices, l, xb, yb, zb);
       l = vertex(tri->vertices, l, xt, yt, zt);
@@ -994,16 +1199,11 @@ Triangulation *TriangulationFactory::cylinder(Arena *arena, const Geometry *geo,
   tri->triangles_n = (shell ? 2 * samples : 0) + (cap[0] ? samples - 2 : 0) + (cap[1] ? samples - 2 : 0);
   tri->indices = (uint32_t *)arena->alloc(3 * sizeof(uint32_t) * tri->triangles_n);
 
-  t0.resize(2 * samples);
-  for (unsigned i = 0; i < samples; i++)
-  {
-    t0[2 * i + 0] = std::cos((twopi / samples) * i + geo->sampleStartAngle);
-    t0[2 * i + 1] = std::sin((twopi / samples) * i + geo->sampleStartAngle);
-  }
+  const float *circle = circleSamples(t0, samples, geo->sampleStartAngle);
   t1.resize(2 * samples);
   for (unsigned i = 0; i < 2 * samples; i++)
   {
-    t1[i] = cy.radius * t0[i];
+    t1[i] = cy.radius * circle[i];
   }
 
   float h2 = 0.5f * cy.height;
@@ -1127,12 +1327,11 @@ Triangulation *TriangulationFactory::sphereBasedShape(Arena *arena, const Geomet
     auto w = t0[2 * r + 1];
     auto n = u0[r];
 
-    auto phi_scale = twopi / n;
+    const float *circle = circleSamples(t1, n, geo->sampleStartAngle);
     for (unsigned i = 0; i < n; i++)
     {
-      auto phi = phi_scale * i + geo->sampleStartAngle;
-      auto nx = w * std::cos(phi);
-      auto ny = w * std::sin(phi);
+      auto nx = w * circle[2 * i + 0];
+      auto ny = w * circle[2 * i + 1];
       l = vertex(tri->vertices, l, radius * nx, radius * ny, z);
     }
   }
@@ -1287,6 +1486,24 @@ Triangulation *TriangulationFactory::facetGroup(Arena *arena, const Geometry *ge
         indices.push_back(vo + 3);
       }
     }
+    else if (poly.contours_n == 1 && isPlanarConvex(poly.contours[0].vertices, poly.contours[0].vertices_n))
+    {
+      // every corner turns, so fanning from first vertex gives no zero area triangles
+      auto &cont = poly.contours[0];
+      auto n = cont.vertices_n;
+      auto vo = uint32_t(vertices.size()) / 3;
+
+      vertices.resize(vertices.size() + 3 * n);
+
+      std::memcpy(vertices.data() + 3 * vo, cont.vertices, 3 * n * sizeof(float));
+
+      for (unsigned i = 1; i + 1 < n; i++)
+      {
+        indices.push_back(vo);
+        indices.push_back(vo + i);
+        indices.push_back(vo + i + 1);
+      }
+    }
     else
     {
 
@@ -1303,7 +1520,7 @@ Triangulation *TriangulationFactory::facetGroup(Arena *arena, const Geometry *ge
       }
       auto m = 0.5f * (Vec3f(bbox.min) + Vec3f(bbox.max));
 
-      auto tess = tessNewTess(nullptr);
+      auto tess = tessNewTess(&tessAlloc);
       for (unsigned c = 0; c < poly.contours_n; c++)
       {
         auto &cont = poly.contours[c];
@@ -1360,6 +1577,7 @@ Triangulation *TriangulationFactory::facetGroup(Arena *arena, const Geometry *ge
       }
 
       tessDeleteTess(tess);
+      tessArena.reset();
     }
 
   skip_polygon:;
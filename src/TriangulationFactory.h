@@ -7,11 +7,16 @@
 
 #include "LinAlg.h"
 #include "Arena.h"
+#include "libtess2/Include/tesselator.h"
 #include <vector>
 
 class TriangulationFactory
 {
 public:
+  TriangulationFactory();
+  TriangulationFactory(const TriangulationFactory &) = delete;
+  TriangulationFactory &operator=(const TriangulationFactory &) = delete;
+
   float tolerance = 0.01;
   unsigned sagittaBasedSegmentCount(float arc, float radius, float scale);
 
@@ -49,4 +54,11 @@ private:
   std::vector<float> t0;
   std::vector<float> t1;
   std::vector<float> t2;
+
+  // libtess2 allocates from here, memory is given back all at once after each polygon
+  Arena tessArena;
+  TESSalloc tessAlloc;
+
+  // cos, sin pairs of n samples around circle, from shared table when possible or computed into scratch
+  const float *circleSamples(std::vector<float> &scratch, unsigned n, float startAngle);
 };
\ No newline at end of file
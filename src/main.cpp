@@ -1,5 +1,6 @@
 #include "RvmParser.h"
 #include <argumentum/argparse-h.h>
+#include <thread>
 
 int main(int argc, char **argv)
 {
@@ -15,6 +16,21 @@ int main(int argc, char **argv)
     bool remove_elements_without_primitives;
     bool remove_duplicate_positions;
     bool is_dry_run;
+    std::string hash_type;
+    bool use_root_index;
+    unsigned threads;
+    std::vector<std::string> include_roots;
+    std::vector<std::string> exclude_roots;
+    std::string incremental_status_file;
+    bool use_stream;
+    uint32_t arena_page_mb;
+    uint32_t arena_keep_mb;
+    bool arena_huge_pages;
+    unsigned tess_cache_mb;
+    unsigned instancing;
+    bool remove_hidden_caps;
+    std::string compress;
+    bool quantize;
 
     auto parser = argumentum::argument_parser{};
     auto params = parser.params();
@@ -23,7 +39,7 @@ int main(int argc, char **argv)
     params.add_parameter(filename_including_path, "--input", "-i")
         .nargs(1)
         .required(true)
-        .help("rvm fileinput --input ./somefile.rvm");
+        .help("rvm fileinput --input ./somefile.rvm, use --input - to read from stdin");
 
     params.add_parameter(output_path, "--output", "-o")
         .nargs(1)
@@ -66,6 +82,81 @@ int main(int argc, char **argv)
         .help("meshopt target_error, default is 0.f, only used when cleanup-position is active");
 
 
+    params.add_parameter(hash_type, "--hash", "-a")
+        .nargs(1)
+        .absent("md5")
+        .choices({"md5", "murmur3"})
+        .help("Hash used for md5 field in status file, default is md5. murmur3 is a lot faster, use -a murmur3");
+
+    params.add_parameter(use_root_index, "--root-index", "-n")
+        .nargs(1)
+        .absent(0)
+        .help("Reads or creates <input>.rvmidx with byte ranges of all roots down to --level, so later runs dont need to scan file. To enable use -n 1");
+
+    params.add_parameter(threads, "--threads", "-j")
+        .nargs(1)
+        .absent(1)
+        .help("Threads to use, each thread generates 1 root at a time. Default is 1, use -j 0 to use all cores");
+
+    params.add_parameter(include_roots, "--include-root", "-I")
+        .minargs(1)
+        .help("Only export roots at --level with name matching pattern, * and ? can be used. Example -I \"/ZONE-A*\"");
+
+    params.add_parameter(exclude_roots, "--exclude-root", "-X")
+        .minargs(1)
+        .help("Skip roots at --level with name matching pattern, * and ? can be used. These are not parsed at all");
+
+    params.add_parameter(incremental_status_file, "--incremental", "-u")
+        .nargs(1)
+        .absent("")
+        .help("status_file.json from last run. Roots with same md5 and existing glb file is kept as is, and not generated again. Only used if options and colors are the same");
+
+    params.add_parameter(use_stream, "--stream", "-s")
+        .nargs(1)
+        .absent(0)
+        .help("Read input front to back with a read ahead thread instead of mapping it into memory, for slow network drives. Used automatically for pipes and --input -. To enable use -s 1");
+
+    params.add_parameter(arena_page_mb, "--arena-page-mb")
+        .nargs(1)
+        .absent(50)
+        .help("Size in MB of memory pages used for triangles, default is 50");
+
+    params.add_parameter(arena_keep_mb, "--arena-keep-mb")
+        .nargs(1)
+        .absent(0)
+        .help("MB of memory pages to keep for next root instead of giving back to the OS, helps with many small roots. Default is 0");
+
+    params.add_parameter(arena_huge_pages, "--huge-pages")
+        .nargs(1)
+        .absent(0)
+        .help("Use transparent huge pages for triangle memory (linux only). To enable use --huge-pages 1");
+
+    params.add_parameter(tess_cache_mb, "--tess-cache-mb")
+        .nargs(1)
+        .absent(0)
+        .help("MB of triangulated primitives to keep for reuse by identical primitives, cleared between roots when full. Default is 0 (off), try --tess-cache-mb 256");
+
+    params.add_parameter(instancing, "--instancing")
+        .nargs(1)
+        .absent(0)
+        .help("Write primitives repeated at least this many times in a mesh once, placed with EXT_mesh_gpu_instancing. Needs --tess-cache-mb, else it is not used. Default is 0 (off)");
+
+    params.add_parameter(remove_hidden_caps, "--remove-hidden-caps")
+        .nargs(1)
+        .absent(0)
+        .help("Connect primitives of each root and skip end caps hidden inside their neighbour, like between pipe segments. To enable use --remove-hidden-caps 1");
+
+    params.add_parameter(compress, "--compress")
+        .nargs(1)
+        .absent("none")
+        .choices({"none", "meshopt"})
+        .help("Compress glb buffers, meshopt uses EXT_meshopt_compression, viewer needs meshopt decoder. Default is none, use --compress meshopt");
+
+    params.add_parameter(quantize, "--quantize")
+        .nargs(1)
+        .absent(0)
+        .help("Writes positions relative to center of each mesh, placed by node translation. Positions are int16 (KHR_mesh_quantization) when a step is within --tolerance, else float. To enable use --quantize 1");
+
     params.add_parameter(tolerance, "--tolerance", "-t")
         .nargs(1)
         .absent(0.01)
@@ -77,6 +168,11 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
     RvmParser rvmParser;
     return rvmParser.read_file(
         filename_including_path, 
@@ -88,6 +184,21 @@ int main(int argc, char **argv)
         tolerance,
         meshopt_threshold,
         meshopt_target_error,
-        is_dry_run
+        is_dry_run,
+        hash_type == "murmur3" ? HashType::murmur3 : HashType::md5,
+        use_root_index,
+        threads,
+        include_roots,
+        exclude_roots,
+        incremental_status_file,
+        use_stream,
+        size_t(std::max(1u, arena_page_mb)) * 1024 * 1024,
+        size_t(arena_keep_mb) * 1024 * 1024,
+        arena_huge_pages,
+        size_t(tess_cache_mb) * 1024 * 1024,
+        instancing,
+        remove_hidden_caps,
+        compress == "meshopt" ? Compression::meshopt : Compression::none,
+        quantize
     );
 }